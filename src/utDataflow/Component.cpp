@@ -31,6 +31,7 @@
 
 #include "Component.h"
 #include <iostream>
+#include <algorithm>
 #include <utUtil/Exception.h>
 #include <log4cpp/Category.hh>
 
@@ -46,6 +47,10 @@ Component::Component( const std::string& name )
 	, m_componentMutex()
 	, m_running( false )
 	, m_eventPriority( 0 )
+	, m_eventGroup( 0 )
+	, m_nQueuedEvents( 0 )
+	, m_nPushGeneration( 0 )
+	, m_nPullDependents( 0 )
 {
 	LOG4CPP_DEBUG( logger, "Component (" << name << ")" );
 }
@@ -76,6 +81,125 @@ void Component::removePort( const std::string& sName )
 }
 
 
+/** \internal mutexes of the components the thread delivers events or pulls to, see Component::beginLocked() */
+static boost::thread_specific_ptr< std::vector< const Component::MutexType* > > g_pLockedMutexes;
+
+
+void Component::beginLocked( const MutexType* pMutex )
+{
+	std::vector< const MutexType* >* pLocked = g_pLockedMutexes.get();
+	if ( !pLocked )
+	{
+		pLocked = new std::vector< const MutexType* >;
+		g_pLockedMutexes.reset( pLocked );
+	}
+	pLocked->push_back( pMutex );
+}
+
+
+void Component::endLocked()
+{
+	g_pLockedMutexes->pop_back();
+}
+
+
+bool Component::isLockedByThisThread( const MutexType* pMutex )
+{
+	const std::vector< const MutexType* >* pLocked = g_pLockedMutexes.get();
+	return pLocked && std::find( pLocked->begin(), pLocked->end(), pMutex ) != pLocked->end();
+}
+
+
+bool Component::isPullSourceLockedByThisThread() const
+{
+	// usually the thread only handles an event or a pull of this component, then there is nothing to search
+	const std::vector< const MutexType* >* pLocked = g_pLockedMutexes.get();
+	if ( !pLocked || std::size_t( std::count( pLocked->begin(), pLocked->end(), &m_componentMutex ) ) == pLocked->size() )
+		return false;
+
+	return isPullSourceLocked( *pLocked );
+}
+
+
+bool Component::isPullSourceLocked( const std::vector< const MutexType* >& locked ) const
+{
+	boost::mutex::scoped_lock l( m_pullSourcesMutex );
+	for ( std::vector< Component* >::const_iterator it = m_pullSources.begin(); it != m_pullSources.end(); it++ )
+		if ( std::find( locked.begin(), locked.end(), &(*it)->m_componentMutex ) != locked.end() || (*it)->isPullSourceLocked( locked ) )
+			return true;
+
+	return false;
+}
+
+
+void Component::advancePushGeneration()
+{
+	m_nPushGeneration.fetch_add( 1, boost::memory_order_release );
+	if ( !m_nPullDependents.load( boost::memory_order_acquire ) )
+		return;
+
+	// components pulling from this one may compute different results now. 
+	// Each is advanced once, even if it is reached on several paths.
+	std::vector< Component* > visited( 1, this );
+	std::vector< Component* > pending;
+	appendPullDependents( pending );
+	while ( !pending.empty() )
+	{
+		Component* pDependent = pending.back();
+		pending.pop_back();
+		if ( std::find( visited.begin(), visited.end(), pDependent ) != visited.end() )
+			continue;
+
+		visited.push_back( pDependent );
+		pDependent->m_nPushGeneration.fetch_add( 1, boost::memory_order_release );
+		pDependent->appendPullDependents( pending );
+	}
+}
+
+
+void Component::appendPullDependents( std::vector< Component* >& dependents ) const
+{
+	boost::mutex::scoped_lock l( m_pullSourcesMutex );
+	dependents.insert( dependents.end(), m_pullDependents.begin(), m_pullDependents.end() );
+}
+
+
+void Component::addPullSource( Component& rSource )
+{
+	{
+		boost::mutex::scoped_lock l( m_pullSourcesMutex );
+		m_pullSources.push_back( &rSource );
+	}
+	{
+		boost::mutex::scoped_lock l( rSource.m_pullSourcesMutex );
+		rSource.m_pullDependents.push_back( this );
+		rSource.m_nPullDependents.store( static_cast< unsigned >( rSource.m_pullDependents.size() ), boost::memory_order_release );
+	}
+
+	advancePushGeneration();
+}
+
+
+void Component::removePullSource( Component& rSource )
+{
+	{
+		boost::mutex::scoped_lock l( m_pullSourcesMutex );
+		std::vector< Component* >::iterator it = std::find( m_pullSources.begin(), m_pullSources.end(), &rSource );
+		if ( it != m_pullSources.end() )
+			m_pullSources.erase( it );
+	}
+	{
+		boost::mutex::scoped_lock l( rSource.m_pullSourcesMutex );
+		std::vector< Component* >::iterator it = std::find( rSource.m_pullDependents.begin(), rSource.m_pullDependents.end(), this );
+		if ( it != rSource.m_pullDependents.end() )
+			rSource.m_pullDependents.erase( it );
+		rSource.m_nPullDependents.store( static_cast< unsigned >( rSource.m_pullDependents.size() ), boost::memory_order_release );
+	}
+
+	advancePushGeneration();
+}
+
+
 Port& Component::getPortByName( const std::string& sName )
 {
     std::map< std::string, Port* >::iterator it = m_PortMap.find( sName );
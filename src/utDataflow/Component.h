@@ -34,9 +34,11 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 
 #include <utDataflow.h>
 
@@ -99,6 +101,13 @@ public:
      */
     Port& getPortByName( const std::string& sName );
 
+	/** type of map of ports by name */
+	typedef std::map< std::string, Port* > PortMap;
+
+	/** returns all ports of the component */
+	const PortMap& getPorts() const
+	{ return m_PortMap; }
+
 	/**
 	 * Start the component.
 	 *
@@ -134,19 +143,121 @@ public:
 	int getEventPriority() const
 	{ return m_eventPriority; }
 
+	/**
+	 * Sets the event scheduling group.
+	 * Components in different groups are not connected in the data flow network, so the
+	 * event queue may dispatch their events in parallel.
+	 */
+	void setEventGroup( int group )
+	{ m_eventGroup = group; }
+
+	/** Returns the event scheduling group. */
+	int getEventGroup() const
+	{ return m_eventGroup; }
+
+	/**
+	 * Called by the event queue before it delivers a group of events with the same timestamp 
+	 * to this component, see EventQueue::setGroupedDelivery(). The component mutex is locked.
+	 */
+	virtual void beginEventBatch()
+	{}
+
+	/**
+	 * Called by the event queue after it delivered a group of events with the same timestamp.
+	 * Components can defer work that depends on several inputs until here.
+	 */
+	virtual void endEventBatch()
+	{}
+
+	/** 
+	 * Returns the number of events queued in the event queue for the ports of this component. 
+	 * Direct dispatch uses it to keep events from overtaking events for other ports, see 
+	 * EventQueue::dispatchDirect().
+	 */
+	int getQueuedEvents() const
+	{ return m_nQueuedEvents.load( boost::memory_order_acquire ); }
+
+	/** changes the number of queued events, called by the event queue */
+	void addQueuedEvents( int nEvents )
+	{ m_nQueuedEvents.fetch_add( nEvents, boost::memory_order_acq_rel ); }
+
+	/**
+	 * Returns the push generation of this component, which changes whenever a pushed event is
+	 * delivered to it or to a component it pulls from, directly or indirectly, and when its pull 
+	 * sources change. Pull caches use it to detect that their results may be outdated, see 
+	 * PullSupplierCore::setCacheSize().
+	 */
+	unsigned long long getPushGeneration() const
+	{ return m_nPushGeneration.load( boost::memory_order_acquire ); }
+
+	/** 
+	 * Advances the push generation of this component and of all components pulling from it, directly 
+	 * or indirectly. Called by the event queue with the component mutex locked, before a pushed event 
+	 * is delivered, so no pull can use a result computed before the event.
+	 */
+	void advancePushGeneration();
+
+	/** registers a component this component pulls from. Called when pull consumer ports are connected. */
+	void addPullSource( Component& rSource );
+
+	/** removes a component registered with addPullSource(). Called when pull consumer ports are disconnected. */
+	void removePullSource( Component& rSource );
+
 	/** type of mutex for later reference */
 	typedef boost::recursive_mutex MutexType;
 	
 	/** returns a reference to the mutex */
 	MutexType& getMutex()
 	{ return m_componentMutex; }
+
+	/**
+	 * Records that the calling thread has locked the mutex of a component to deliver an event or a
+	 * pull to it. Must be paired with endLocked() in reverse order, see LockedScope.
+	 */
+	static void beginLocked( const MutexType* pMutex );
+
+	/** removes the record of the last beginLocked() of the calling thread */
+	static void endLocked();
+
+	/** returns true if the calling thread has recorded the mutex with beginLocked() */
+	static bool isLockedByThisThread( const MutexType* pMutex );
+
+	/**
+	 * Returns true if the calling thread delivers an event or a pull to a component this component
+	 * pulls from, directly or indirectly. Another thread pulling from this component could then wait 
+	 * for the calling thread, so the calling thread must not wait for it.
+	 */
+	bool isPullSourceLockedByThisThread() const;
+
+	/** calls beginLocked() and endLocked() for a scope, does nothing for a null mutex */
+	class LockedScope
+		: private boost::noncopyable
+	{
+	public:
+		LockedScope( const MutexType* pMutex )
+			: m_pMutex( pMutex )
+		{ if ( m_pMutex ) beginLocked( m_pMutex ); }
+
+		~LockedScope()
+		{ if ( m_pMutex ) endLocked(); }
+
+	protected:
+		const MutexType* m_pMutex;
+	};
 	
 protected:
+	/** helper of isPullSourceLockedByThisThread() */
+	bool isPullSourceLocked( const std::vector< const MutexType* >& locked ) const;
+
+	/** helper of advancePushGeneration(), appends the components pulling directly from this one */
+	void appendPullDependents( std::vector< Component* >& dependents ) const;
+
+
 	/** the name of the component */
 	std::string m_name;
 
 	/** a map of all ports */
-	std::map< std::string, Port* > m_PortMap;
+	PortMap m_PortMap;
 
 
 	/** mutex to lock the component */
@@ -159,6 +270,27 @@ protected:
 	 * Note: this is the priority of events received (not sent) by the component!
 	 */
 	int m_eventPriority;
+
+	/** The group of connected components this component belongs to, used for parallel event scheduling. */
+	int m_eventGroup;
+
+	/** number of events queued for the ports of this component, see getQueuedEvents() */
+	boost::atomic< int > m_nQueuedEvents;
+
+	/** push generation, see getPushGeneration() */
+	boost::atomic< unsigned long long > m_nPushGeneration;
+
+	/** protects m_pullSources and m_pullDependents */
+	mutable boost::mutex m_pullSourcesMutex;
+
+	/** components this component pulls from, once for each connected pull consumer port */
+	std::vector< Component* > m_pullSources;
+
+	/** components pulling from this component, once for each connected pull consumer port */
+	std::vector< Component* > m_pullDependents;
+
+	/** size of m_pullDependents, read without locking */
+	boost::atomic< unsigned > m_nPullDependents;
 };
 
 
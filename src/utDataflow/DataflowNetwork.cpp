@@ -30,10 +30,15 @@
  */
 
 
+#include <cctype>
+#include <algorithm>
+
 #include "DataflowNetwork.h"
 #include "Component.h"
 #include "ComponentFactory.h"
 #include "Port.h"
+#include "EventQueue.h"
+#include "ShmTransport.h"
 #include <utGraph/UTQLDocument.h>
 
 #include <log4cpp/Category.hh>
@@ -45,11 +50,23 @@ namespace Ubitrack { namespace Dataflow {
 	// Constructor just stores the factory
 	DataflowNetwork::DataflowNetwork (ComponentFactory &factory)
 		:m_componentFactory (factory)
+		, m_bEventQueueStarted( false )
+	{}
+
+
+	DataflowNetwork::DataflowNetwork( ComponentFactory& factory, boost::shared_ptr< EventQueue > pEventQueue )
+		: m_componentFactory( factory )
+		, m_pEventQueue( pEventQueue )
+		, m_bEventQueueStarted( false )
 	{}
 
 
 	DataflowNetwork::~DataflowNetwork ()
 	{
+		// other networks may still use the queue
+		if ( m_bEventQueueStarted )
+			m_pEventQueue->stopShared();
+
 		// destroy all components in the network
 		while (!m_componentIDMap.empty ())
 			dropComponent (m_componentIDMap.begin()->first);
@@ -109,6 +126,10 @@ namespace Ubitrack { namespace Dataflow {
 				{
 					createComponent( subgraph );
 
+					// caches must be enabled before the consumers are connected
+					configurePullCaches( subgraph );
+					configureHistories( subgraph );
+
 					LOG4CPP_DEBUG( logger, (std::string)"Created component: " + (*it)->m_ID
 									+ " [" + (*it)->m_Name + "]" );
 				}
@@ -137,6 +158,15 @@ namespace Ubitrack { namespace Dataflow {
 
 				// XXX: TODO: sucks. this should be handeled by the InOutAttributeIterator
 				Graph::UTQLSubgraph::EdgePtr edge = it->second;
+
+				// edges to other processes
+				if ( edge->getAttributeString( "transport" ) == "shm" )
+				{
+					if ( !subgraph->m_DataflowConfiguration.isEmpty() )
+						connectShmTransport( subgraph, it->first );
+					continue;
+				}
+
 				if ( !edge->isInput() )
 					continue;
 				
@@ -164,6 +194,9 @@ namespace Ubitrack { namespace Dataflow {
 					// srcName, srcPort, dstName, dstPort
 					connectComponents( otherSubgraphId, edge->m_EdgeReference.getEdgeName(),
 									   subgraph->m_ID, edge->m_Name );
+
+					// apply queueing options of the edge to the receiving port
+					configureQueue( subgraph->m_ID, edge->m_Name, *edge );
 				}
 			}
 		}
@@ -239,8 +272,21 @@ namespace Ubitrack { namespace Dataflow {
 		LOG4CPP_DEBUG( logger, "Dropping component: " << name );
 
 		disconnectComponent (name);
+
+		// the component must not receive events queued before it was disconnected
+		getEventQueue().removeComponent( it->second.get() );
 		m_componentIDMap.erase (name);
 
+		// drop the shared memory transports of the component, unless dropped already
+		std::pair< ShmEndpointMap::iterator, ShmEndpointMap::iterator > endpointRange( m_shmEndpoints.equal_range( name ) );
+		std::vector< std::string > endpoints;
+		for ( ShmEndpointMap::iterator itEndpoint = endpointRange.first; itEndpoint != endpointRange.second; itEndpoint++ )
+			endpoints.push_back( itEndpoint->second );
+		m_shmEndpoints.erase( endpointRange.first, endpointRange.second );
+
+		for ( std::vector< std::string >::iterator itEndpoint = endpoints.begin(); itEndpoint != endpoints.end(); itEndpoint++ )
+			if ( m_componentIDMap.find( *itEndpoint ) != m_componentIDMap.end() )
+				dropComponent( *itEndpoint );
 	}
 
 	void DataflowNetwork::connectComponents ( const DataflowNetworkConnection& connection )
@@ -258,6 +304,10 @@ namespace Ubitrack { namespace Dataflow {
 		Port *dstPort;
 		boost::tie (srcPort, dstPort) = getPortPair ( connection );
 
+		// events are delivered by the queue of this network
+		srcPort->setEventQueue( getEventQueue() );
+		dstPort->setEventQueue( getEventQueue() );
+
 		// we need to connect in both directions since we do not
 		// know which protocol (push/pull) is involved
 		try
@@ -287,6 +337,187 @@ namespace Ubitrack { namespace Dataflow {
 	}
 
 
+	DataflowNetwork::QueueStatisticsMap DataflowNetwork::getQueueStatistics() const
+	{
+		QueueStatisticsMap result;
+		for ( ComponentMap::const_iterator itComp = m_componentIDMap.begin(); itComp != m_componentIDMap.end(); itComp++ )
+		{
+			const Component::PortMap& ports( itComp->second->getPorts() );
+			for ( Component::PortMap::const_iterator itPort = ports.begin(); itPort != ports.end(); itPort++ )
+			{
+				const Port::ReceiverInfoList& receivers( itPort->second->getReceiverInfos() );
+				for ( Port::ReceiverInfoList::const_iterator it = receivers.begin(); it != receivers.end(); it++ )
+				{
+					EventQueue::ReceiverStatistics stats( (*it)->getStatistics() );
+					if ( it == receivers.begin() )
+					{
+						result[ itPort->second->fullName() ] = stats;
+						continue;
+					}
+
+					// sum up the receivers of the port
+					EventQueue::ReceiverStatistics& sum( result[ itPort->second->fullName() ] );
+					sum.nQueuedEvents += stats.nQueuedEvents;
+					sum.nHighWaterMark = std::max( sum.nHighWaterMark, stats.nHighWaterMark );
+					sum.nEnqueued += stats.nEnqueued;
+					sum.nDispatched += stats.nDispatched;
+					sum.nDropped += stats.nDropped;
+					sum.nExpired += stats.nExpired;
+					sum.nDirect += stats.nDirect;
+					for ( int i = 0; i < EventQueue::latencyBuckets; i++ )
+						sum.latencyHistogram[ i ] += stats.latencyHistogram[ i ];
+				}
+			}
+		}
+		return result;
+	}
+
+
+	void DataflowNetwork::configureQueue( const std::string& componentName, const std::string& portName,
+		const Graph::KeyValueAttributes& attributes )
+	{
+		if ( !attributes.hasAttribute( "maxQueueLength" ) && !attributes.hasAttribute( "queuePolicy" ) &&
+			!attributes.hasAttribute( "maxEventAge" ) )
+			return;
+
+		ComponentMap::iterator it = m_componentIDMap.find( componentName );
+		if ( it == m_componentIDMap.end() )
+			UBITRACK_THROW( "component " + componentName + " not found" );
+		Port* pPort = &it->second->getPortByName( portName );
+
+		if ( attributes.hasAttribute( "maxEventAge" ) )
+		{
+			// given in milliseconds
+			double maxAge = 0.0;
+			attributes.getAttributeData( "maxEventAge", maxAge );
+			LOG4CPP_DEBUG( logger, "Maximum event age for " << pPort->fullName() << ": " << maxAge << "ms" );
+			pPort->setMaxEventAge( static_cast< unsigned long long >( maxAge * 1e6 ) );
+		}
+
+		if ( !attributes.hasAttribute( "maxQueueLength" ) && !attributes.hasAttribute( "queuePolicy" ) )
+			return;
+
+		// start from the current settings of the port
+		int nMaxQueueLength = -1;
+		EventQueue::OverflowPolicy policy = EventQueue::overflow_drop_oldest;
+		if ( !pPort->getReceiverInfos().empty() )
+		{
+			nMaxQueueLength = pPort->getReceiverInfos().front()->nMaxQueueLength;
+			policy = pPort->getReceiverInfos().front()->overflowPolicy;
+		}
+
+		attributes.getAttributeData( "maxQueueLength", nMaxQueueLength );
+		if ( attributes.hasAttribute( "queuePolicy" ) )
+			policy = EventQueue::parseOverflowPolicy( attributes.getAttributeString( "queuePolicy" ) );
+
+		LOG4CPP_DEBUG( logger, "Queueing for " << pPort->fullName() << ": maxQueueLength=" << nMaxQueueLength
+			<< ", policy=" << policy );
+		pPort->setQueuePolicy( nMaxQueueLength, policy );
+	}
+
+
+	void DataflowNetwork::configurePullCaches( boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+	{
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ )
+		{
+			if ( !it->second->isOutput() || !it->second->hasAttribute( "pullCacheSize" ) )
+				continue;
+
+			int nEntries = 0;
+			it->second->getAttributeData( "pullCacheSize", nEntries );
+			Port& rPort( m_componentIDMap[ subgraph->m_ID ]->getPortByName( it->first ) );
+			LOG4CPP_DEBUG( logger, "Pull cache for " << rPort.fullName() << ": " << nEntries << " entries" );
+			rPort.setPullCacheSize( std::max( 0, nEntries ) );
+		}
+	}
+
+
+	void DataflowNetwork::configureHistories( boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+	{
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ )
+		{
+			if ( !it->second->isInput() || 
+				( !it->second->hasAttribute( "historySize" ) && !it->second->hasAttribute( "historyTolerance" ) ) )
+				continue;
+
+			Port& rPort( m_componentIDMap[ subgraph->m_ID ]->getPortByName( it->first ) );
+
+			// start from the current settings of the port
+			int nSamples = static_cast< int >( rPort.getHistorySize() );
+			it->second->getAttributeData( "historySize", nSamples );
+
+			// given in milliseconds
+			double tolerance = rPort.getHistoryTolerance() * 1e-6;
+			it->second->getAttributeData( "historyTolerance", tolerance );
+
+			LOG4CPP_DEBUG( logger, "History for " << rPort.fullName() << ": " << nSamples << " measurements, tolerance " << tolerance << "ms" );
+			rPort.setHistory( std::max( 1, nSamples ), static_cast< unsigned long long >( std::max( 0.0, tolerance ) * 1e6 ) );
+		}
+	}
+
+
+	/** \internal name of the shared memory segment of an output edge */
+	static std::string shmChannelName( const std::string& sPatternId, const std::string& sEdgeName )
+	{
+		std::string sName( "ubitrack_" + sPatternId + "_" + sEdgeName );
+		for ( std::string::iterator it = sName.begin(); it != sName.end(); it++ )
+			if ( !std::isalnum( static_cast< unsigned char >( *it ) ) )
+				*it = '_';
+		return sName;
+	}
+
+
+	void DataflowNetwork::connectShmTransport( boost::shared_ptr< Graph::UTQLSubgraph > subgraph, const std::string& sEdgeName )
+	{
+		Graph::UTQLSubgraph::EdgePtr edge( subgraph->m_Edges[ sEdgeName ] );
+		const bool bSend = edge->isOutput();
+		const std::string sEndpoint( subgraph->m_ID + ":" + sEdgeName + ":shm" );
+		const std::string sEndpointPort( bSend ? "Input" : "Output" );
+
+		// the transport is kept when the component is reconfigured
+		if ( m_componentIDMap.find( sEndpoint ) == m_componentIDMap.end() )
+		{
+			ShmTransport::Channel channel;
+			if ( edge->hasAttribute( "shmChannel" ) )
+				channel.sName = edge->getAttributeString( "shmChannel" );
+			else if ( bSend )
+				channel.sName = shmChannelName( subgraph->m_ID, sEdgeName );
+			else if ( !edge->m_EdgeReference.empty() )
+				channel.sName = shmChannelName( edge->m_EdgeReference.getSubgraphId(), edge->m_EdgeReference.getEdgeName() );
+			else
+				UBITRACK_THROW( "Shared memory edge " + subgraph->m_ID + ":" + sEdgeName + " needs an edge reference or a shmChannel attribute" );
+
+			int nSlots = static_cast< int >( channel.nSlots );
+			int nSlotSize = static_cast< int >( channel.nSlotSize );
+			edge->getAttributeData( "shmSlots", nSlots );
+			edge->getAttributeData( "shmSlotSize", nSlotSize );
+			channel.nSlots = std::max( 1, nSlots );
+			channel.nSlotSize = std::max( 1, nSlotSize );
+
+			LOG4CPP_DEBUG( logger, "Shared memory transport for " << subgraph->m_ID << ":" << sEdgeName << ": " << channel.sName
+				<< ", " << channel.nSlots << " slots of " << channel.nSlotSize << " bytes" );
+
+			boost::shared_ptr< ShmTransportComponent > pEndpoint( new ShmTransportComponent( sEndpoint ) );
+			Port& rPort( m_componentIDMap[ subgraph->m_ID ]->getPortByName( sEdgeName ) );
+			pEndpoint->setEndpoint( ShmTransport::createEndpoint( rPort, bSend, sEndpointPort, *pEndpoint, channel ) );
+			m_componentIDMap[ sEndpoint ] = pEndpoint;
+			m_shmEndpoints.insert( std::make_pair( subgraph->m_ID, sEndpoint ) );
+		}
+
+		// the queueing options of the edge apply to the port receiving the events in this process
+		if ( bSend )
+		{
+			connectComponents( subgraph->m_ID, sEdgeName, sEndpoint, sEndpointPort );
+			configureQueue( sEndpoint, sEndpointPort, *edge );
+		}
+		else
+		{
+			connectComponents( sEndpoint, sEndpointPort, subgraph->m_ID, sEdgeName );
+			configureQueue( subgraph->m_ID, sEdgeName, *edge );
+		}
+	}
+
+
 	void DataflowNetwork::connectComponents (std::string srcName,
 											 std::string srcPortName,
 											 std::string dstName,
@@ -418,6 +649,16 @@ namespace Ubitrack { namespace Dataflow {
 				it->second->stop();
 			}
 		}
+		// a separate event queue is controlled by the networks using it
+		if ( m_pEventQueue && start != m_bEventQueueStarted )
+		{
+			if ( start )
+				m_pEventQueue->startShared();
+			else
+				m_pEventQueue->stopShared();
+			m_bEventQueueStarted = start;
+		}
+
 		if ( start )
 		{
 			LOG4CPP_INFO( logger, "Dataflow started" );
@@ -449,15 +690,12 @@ namespace Ubitrack { namespace Dataflow {
 		{}
 	};
 
-	// FIXME: This is a hack, as priorities are now counted downwards, starting at the sinks.
+	// Priorities are counted downwards, starting at the sinks.
 	// This is necessary so that all events to sinks which belong to the same module are delivered
 	// simultaneously, as the DFN does not know about module ownership.
-	// The value should stay below 1000 so that the sorting order in the event queue is not disturbed.
-	// It simply looks at (timestamp + priority) and relies on timestamps being always more coarse
-	// than their storage data type, so that the least-significant digits are 0.
-	// The best solution, however, is to start counting at 0 again and have the event queue sorting consider
-	// timestamp and priority separately.
-	#define DFN_MAX_PATHLENGTH 255
+	// The event queue sorts by (timestamp, priority), so the value is independent of the timestamp
+	// resolution and only limits the maximum length of a path in the network.
+	#define DFN_MAX_PATHLENGTH 65535
 
 	void DataflowNetwork::assignEventPriorities()
 	{
@@ -520,10 +758,39 @@ namespace Ubitrack { namespace Dataflow {
 				}
 			}
 
+		// assign each weakly connected part of the network its own event group, so the event queue
+		// can dispatch events of unrelated parts in parallel
+		int nGroups = 0;
+		std::set< std::string > assigned;
+		for ( ComponentMap::iterator it = m_componentIDMap.begin(); it != m_componentIDMap.end(); it++ )
+			if ( assigned.insert( it->first ).second )
+			{
+				std::vector< std::string > search( 1, it->first );
+				while ( !search.empty() )
+				{
+					std::string name( search.back() );
+					search.pop_back();
+					m_componentIDMap[ name ]->setEventGroup( nGroups );
+
+					// add all neighbours in both directions
+					const ConnectionSet& inConns( m_inConnectionMap[ name ] );
+					for ( ConnectionSet::const_iterator itIn = inConns.begin(); itIn != inConns.end(); itIn++ )
+						if ( assigned.insert( itIn->m_source.m_componentName ).second )
+							search.push_back( itIn->m_source.m_componentName );
+
+					const ConnectionSet& outConns( m_outConnectionMap[ name ] );
+					for ( ConnectionSet::const_iterator itOut = outConns.begin(); itOut != outConns.end(); itOut++ )
+						if ( assigned.insert( itOut->m_destination.m_componentName ).second )
+							search.push_back( itOut->m_destination.m_componentName );
+				}
+				nGroups++;
+			}
+
 		// debug output
 		if ( logger.isDebugEnabled() )
 			for ( ComponentMap::iterator it = m_componentIDMap.begin(); it != m_componentIDMap.end(); it++ )
-				LOG4CPP_DEBUG( logger, it->first << " has priority " << it->second->getEventPriority() );
+				LOG4CPP_DEBUG( logger, it->first << " has priority " << it->second->getEventPriority()
+					<< ", group " << it->second->getEventGroup() );
 	}
 
 } } // namespace Ubitrack::Dataflow
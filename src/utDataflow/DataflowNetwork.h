@@ -49,6 +49,7 @@
 #include <utDataflow.h>
 #include <utUtil/Exception.h>
 #include <utDataflow/Component.h>
+#include <utDataflow/EventQueue.h>
 
 // forward decls
 namespace Ubitrack {
@@ -59,6 +60,7 @@ namespace Ubitrack {
 	namespace Graph {
 		class UTQLDocument;
 		class UTQLSubgraph;
+		class KeyValueAttributes;
 	}
 }
 
@@ -193,6 +195,19 @@ namespace Ubitrack { namespace Dataflow {
 		 */
 		DataflowNetwork(ComponentFactory& factory);
 
+		/**
+		 * Dataflow Network constructor with a separate event queue
+		 *
+		 * Events of the components in this network are dispatched by the given queue
+		 * instead of the global event queue, so independent networks do not share
+		 * dispatching threads and locks. The queue is started and stopped together
+		 * with the network, see EventQueue::startShared(). If it is shared with other 
+		 * networks, it keeps running until all of them have been stopped.
+		 * @param factory the component factory to be used
+		 * @param pEventQueue the event queue, may be shared with other networks
+		 */
+		DataflowNetwork( ComponentFactory& factory, boost::shared_ptr< EventQueue > pEventQueue );
+
 		/**
 		 * Dataflow Network destructor
 		 *
@@ -415,8 +430,25 @@ namespace Ubitrack { namespace Dataflow {
 			return matches;
 		}
 
+		/** returns the event queue that dispatches the events of this network */
+		EventQueue& getEventQueue()
+		{ return m_pEventQueue ? *m_pEventQueue : EventQueue::singleton(); }
+
+		/** type of map of event queue statistics by full port name */
+		typedef std::map< std::string, EventQueue::ReceiverStatistics > QueueStatisticsMap;
+
+		/**
+		 * Returns the event queue statistics of all ports that receive pushed events
+		 *
+		 * The statistics are indexed by the full port name ("component:port"). Ports with
+		 * several receivers report the sum of their counters.
+		 * @return map of statistics by port name
+		 */
+		QueueStatisticsMap getQueueStatistics() const;
+
 		/**
 		 * Assigns events priorities to the components.
+		 * Also assigns an event group to every connected part of the network.
 		 */
 		void assignEventPriorities();
 
@@ -433,6 +465,58 @@ namespace Ubitrack { namespace Dataflow {
 		 */
 		boost::tuple<Port*, Port*> getPortPair( const DataflowNetworkConnection& connection );
 
+		/**
+		 * Configures the event queueing of a receiving port from UTQL edge attributes
+		 *
+		 * The attribute "maxQueueLength" limits the number of queued events (negative for
+		 * unlimited queueing), "queuePolicy" selects what happens when the limit is reached
+		 * ("drop-oldest", "drop-newest", "block-producer" or "conflate"). "maxEventAge" sets the
+		 * age in milliseconds after which events are discarded instead of dispatched (0 for no limit).
+		 * Ports without these attributes keep the defaults of their event type.
+		 * @param componentName name of the receiving component
+		 * @param portName name of the receiving port
+		 * @param attributes the attributes of the UTQL edge
+		 * @throws Ubitrack::Util::Exception if the policy is unknown
+		 */
+		void configureQueue( const std::string& componentName, const std::string& portName, const Graph::KeyValueAttributes& attributes );
+
+		/**
+		 * Enables pull caches of a new component from UTQL edge attributes
+		 *
+		 * The attribute "pullCacheSize" on an output edge caches the results of that many
+		 * timestamps at the pull supplier port, see PullSupplierCore::setCacheSize().
+		 * @param subgraph the UTQL subgraph of the component
+		 * @throws Ubitrack::Util::Exception if the port does not supply pulled events
+		 */
+		void configurePullCaches( boost::shared_ptr< Graph::UTQLSubgraph > subgraph );
+
+		/**
+		 * Configures the history of the input ports of a new component from UTQL edge attributes
+		 *
+		 * The attribute "historySize" on an input edge sets the number of measurements kept by the
+		 * port, "historyTolerance" the maximum time difference in milliseconds of a measurement
+		 * used for a requested timestamp (0 for exact matches). See HistoryInPort.
+		 * @param subgraph the UTQL subgraph of the component
+		 * @throws Ubitrack::Util::Exception if the port does not keep a history
+		 */
+		void configureHistories( boost::shared_ptr< Graph::UTQLSubgraph > subgraph );
+
+		/**
+		 * Connects a port to another process through shared memory
+		 *
+		 * Used for edges with the attribute transport="shm". The port is connected to a ShmPushConsumer
+		 * (output edges) or a ShmPushSupplier (input edges) of a ShmTransportComponent, which is
+		 * created once per edge and dropped together with the component. The attribute "shmChannel"
+		 * names the shared memory segment. By default, the name is derived from the pattern id and the
+		 * name of the output edge, so both processes use the same segment. "shmSlots" and "shmSlotSize"
+		 * set the number of events in the ring and their maximum size in bytes. They must be equal in
+		 * both processes. The event type of the port must be registered with ShmTransport::registerEventType().
+		 * @param subgraph the UTQL subgraph of the component
+		 * @param sEdgeName name of the edge
+		 * @throws Ubitrack::Util::Exception if the event type is not registered or the shared memory cannot be opened
+		 */
+		void connectShmTransport( boost::shared_ptr< Graph::UTQLSubgraph > subgraph, const std::string& sEdgeName );
+
 		/// Map that stores all currently existent components by name
 		/// The component name is the pattern id from the response
 		typedef std::map< std::string, boost::shared_ptr<Component> > ComponentMap;
@@ -447,9 +531,22 @@ namespace Ubitrack { namespace Dataflow {
 		/// Keep a reference to the component factory
 		ComponentFactory& m_componentFactory;
 
+		/// The event queue of this network, empty if the global event queue is used.
+		/// Declared before the components, so it is destroyed after them.
+		boost::shared_ptr< EventQueue > m_pEventQueue;
+
+		/// True if the network has started m_pEventQueue
+		bool m_bEventQueueStarted;
+
 		/// Map storing all components by component name
 		ComponentMap m_componentIDMap;
 
+		/// Map that stores for each component (by name) the names of its shared memory transport components
+		typedef std::multimap< std::string, std::string > ShmEndpointMap;
+
+		/// Shared memory transport components of all components
+		ShmEndpointMap m_shmEndpoints;
+
 		/// Map for all components of all incoming connections
 		ConnectionMap m_inConnectionMap;
 		/// Map for all components of all outgoing connections
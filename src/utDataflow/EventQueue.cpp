@@ -29,13 +29,24 @@
  * @author Daniel Pustka <daniel.pustka@in.tum.de>
  */
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <log4cpp/Category.hh>
 #include <utUtil/Exception.h>
 #include <utMeasurement/Timestamp.h>
 #include "Port.h"
 #include "EventQueue.h"
+#include "EventTracer.h"
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+#endif
 
 // get loggers
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.EventQueue" ) );
@@ -44,8 +55,72 @@ static log4cpp::Category& eventLogger( log4cpp::Category::getInstance( "Ubitrack
 // minimum time between "events dropped" messages
 static const unsigned long long g_eventsDroppedMessageInterval( 1000000000ll );
 
+// number of event records allocated at once
+static const std::size_t g_eventSlabSize( 256 );
+
 namespace Ubitrack { namespace Dataflow {
 
+/** \internal heap comparison that puts the earliest event at the front of the queue */
+struct LaterEvent
+{
+	bool operator()( const EventQueue::EventRecord* a, const EventQueue::EventRecord* b ) const
+	{ return a->isLaterThan( *b ); }
+};
+
+/** \internal the thread-specific pointer must not delete the queue */
+static void noCleanup( EventQueue* )
+{}
+
+/** \internal set in all event dispatching threads, used to avoid blocking them */
+static boost::thread_specific_ptr< EventQueue > g_pDispatchingQueue( &noCleanup );
+
+/** \internal direct dispatch state of a thread */
+struct DirectDispatchState
+{
+	DirectDispatchState()
+		: nDepth( 0 )
+	{}
+
+	/** number of nested direct calls */
+	unsigned nDepth;
+};
+
+/** \internal set in threads that used direct dispatch */
+static boost::thread_specific_ptr< DirectDispatchState > g_pDirectDispatchState;
+
+/** \internal outdates cached pull results of the receiving component before it handles an event */
+static void advancePushGeneration( EventQueue::ReceiverInfo* pReceiverInfo )
+{
+	if ( pReceiverInfo )
+		pReceiverInfo->pPort->getComponent().advancePushGeneration();
+}
+
+/** \internal returns the component receiving an event, 0 if unknown */
+static const Component* receivingComponent( const EventQueue::EventRecord* pRecord )
+{ return pRecord->pReceiverInfo ? &pRecord->pReceiverInfo->pPort->getComponent() : 0; }
+
+/** \internal parses a list of CPUs like "0,2-3" */
+static std::vector< int > parseCpuList( const std::string& sList )
+{
+	std::vector< int > cpus;
+	std::istringstream stream( sList );
+	std::string sItem;
+	while ( std::getline( stream, sItem, ',' ) )
+	{
+		int first, last;
+		char dash;
+		std::istringstream item( sItem );
+		if ( !( item >> first ) )
+			UBITRACK_THROW( "Invalid CPU list: " + sList );
+		last = first;
+		if ( item >> dash && ( dash != '-' || !( item >> last ) ) )
+			UBITRACK_THROW( "Invalid CPU list: " + sList );
+		for ( int i = first; i <= last; i++ )
+			cpus.push_back( i );
+	}
+	return cpus;
+}
+
 // the singleton event queue object
 static boost::scoped_ptr< EventQueue > g_pEventQueue;
 static int g_RefEventQueue = 0;
@@ -69,27 +144,290 @@ void EventQueue::destroyEventQueue()
 }
 
 
-EventQueue::EventQueue()
-	: m_State( state_stopped )
+EventQueue::OverflowPolicy EventQueue::parseOverflowPolicy( const std::string& sName )
 {
-	// create a new thread
-	m_pThread = boost::shared_ptr< boost::thread >( new boost::thread( boost::bind( &EventQueue::threadFunction, this ) ) );
+	if ( sName == "drop-oldest" )
+		return overflow_drop_oldest;
+	else if ( sName == "drop-newest" )
+		return overflow_drop_newest;
+	else if ( sName == "block-producer" )
+		return overflow_block_producer;
+	else if ( sName == "conflate" )
+		return overflow_conflate;
+
+	UBITRACK_THROW( "Unknown event queue overflow policy: " + sName );
+}
+
+
+EventQueue::EventQueue( unsigned nThreads )
+	: m_nextSequence( 0 )
+	, m_pIngress( 0 )
+	, m_freeEvents( g_eventSlabSize )
+	, m_statisticsStartTime( Measurement::now() )
+	, m_nDispatched( 0 )
+	, m_dispatchTime( 0 )
+	, m_nThreads( 0 )
+	, m_nBatchSize( 16 )
+	, m_bGroupedDelivery( false )
+	, m_schedulingPolicy( scheduling_default )
+	, m_schedulingPriority( 0 )
+	, m_nMaxDirectDepth( 4 )
+	, m_nSharedStarts( 0 )
+	, m_bRunning( false )
+	, m_nWaitingThreads( 0 )
+	, m_State( state_stopped )
+{
+	// tracing can be enabled from the environment
+	EventTracer::enableFromEnvironment();
+
+	// the number of threads can be overridden from the environment
+	if ( nThreads == 0 )
+	{
+		const char* pThreads = std::getenv( "UBITRACK_EVENTQUEUE_THREADS" );
+		if ( pThreads )
+			nThreads = static_cast< unsigned >( std::max( 1, std::atoi( pThreads ) ) );
+		else
+			nThreads = 1;
+	}
+
+	// the batch size can be overridden from the environment
+	const char* pBatchSize = std::getenv( "UBITRACK_EVENTQUEUE_BATCH" );
+	if ( pBatchSize )
+		m_nBatchSize = static_cast< unsigned >( std::max( 1, std::atoi( pBatchSize ) ) );
+
+	const char* pGrouped = std::getenv( "UBITRACK_EVENTQUEUE_GROUPED" );
+	if ( pGrouped )
+		m_bGroupedDelivery = std::atoi( pGrouped ) != 0;
+
+	// thread settings can be given in the environment
+	const char* pCpus = std::getenv( "UBITRACK_EVENTQUEUE_CPUS" );
+	if ( pCpus )
+	{
+		try
+		{
+			m_cpuAffinity = parseCpuList( pCpus );
+		}
+		catch ( const Ubitrack::Util::Exception& e )
+		{
+			LOG4CPP_WARN( logger, "Ignoring UBITRACK_EVENTQUEUE_CPUS: " << e );
+		}
+	}
+
+	const char* pScheduling = std::getenv( "UBITRACK_EVENTQUEUE_SCHED" );
+	if ( pScheduling )
+	{
+		std::string sScheduling( pScheduling );
+		std::string::size_type colon = sScheduling.find( ':' );
+		std::string sPolicy( sScheduling.substr( 0, colon ) );
+		int priority = colon != std::string::npos ? std::atoi( sScheduling.c_str() + colon + 1 ) : 1;
+		if ( sPolicy == "fifo" )
+			m_schedulingPolicy = scheduling_fifo;
+		else if ( sPolicy == "rr" )
+			m_schedulingPolicy = scheduling_rr;
+		else
+			LOG4CPP_WARN( logger, "Ignoring UBITRACK_EVENTQUEUE_SCHED: unknown policy " << sPolicy );
+		m_schedulingPriority = priority;
+	}
+
+	// create the dispatching threads
+	startThreads( nThreads );
 }
 
 
 EventQueue::~EventQueue()
 {
 	LOG4CPP_INFO( eventLogger, "Destroying EventQueue" );
-	// tell thread to quit
+
+	// tell threads to quit and wait until they have actually quit
+	endThreads();
+
+	// release events that have not been dispatched
+	clear();
+
+	LOG4CPP_INFO( eventLogger, "Destroyed EventQueue" );
+}
+
+
+void EventQueue::startThreads( unsigned nThreads )
+{
+	{
+		boost::mutex::scoped_lock l( m_Mutex );
+		m_State = state_stopped;
+		m_nThreads = nThreads;
+	}
+
+	LOG4CPP_INFO( logger, "Starting " << nThreads << " event queue thread(s)" );
+	for ( unsigned i = 0; i < nThreads; i++ )
+		m_threads.push_back( boost::shared_ptr< boost::thread >( new boost::thread( boost::bind( &EventQueue::threadFunction, this ) ) ) );
+
+	applyThreadSettings();
+}
+
+
+void EventQueue::endThreads()
+{
+	// tell threads to quit
 	{
 		boost::mutex::scoped_lock l( m_Mutex );
 		m_State = state_end;
 		m_NewEventCondition.notify_all();
+		m_SpaceCondition.notify_all();
 	}
 
-	// wait until thread has actually quit
-	m_pThread->join();
-	LOG4CPP_INFO( eventLogger, "Destroyed EventQueue" );
+	// wait until all threads have actually quit
+	for ( unsigned i = 0; i < m_threads.size(); i++ )
+		m_threads[ i ]->join();
+	m_threads.clear();
+}
+
+
+void EventQueue::setNumberOfThreads( unsigned nThreads )
+{
+	if ( nThreads == 0 )
+		nThreads = 1;
+
+	bool bRunning;
+	{
+		boost::mutex::scoped_lock l( m_Mutex );
+		if ( nThreads == m_nThreads )
+			return;
+		bRunning = m_State == state_running;
+	}
+
+	// replace the threads, keeping the queued events
+	stop();
+	endThreads();
+	startThreads( nThreads );
+
+	if ( bRunning )
+		start();
+}
+
+
+unsigned EventQueue::getNumberOfThreads() const
+{
+	return m_nThreads;
+}
+
+
+void EventQueue::setBatchSize( unsigned nBatchSize )
+{
+	boost::mutex::scoped_lock l( m_Mutex );
+	m_nBatchSize = std::max( 1u, nBatchSize );
+}
+
+
+unsigned EventQueue::getBatchSize() const
+{
+	return m_nBatchSize;
+}
+
+
+void EventQueue::setGroupedDelivery( bool bGrouped )
+{
+	boost::mutex::scoped_lock l( m_Mutex );
+	m_bGroupedDelivery = bGrouped;
+}
+
+
+bool EventQueue::getGroupedDelivery() const
+{
+	return m_bGroupedDelivery;
+}
+
+
+void EventQueue::setThreadAffinity( const std::vector< int >& cpus )
+{
+	{
+		boost::mutex::scoped_lock l( m_Mutex );
+		m_cpuAffinity = cpus;
+	}
+	applyThreadSettings();
+}
+
+
+void EventQueue::setThreadScheduling( SchedulingPolicy policy, int priority )
+{
+	{
+		boost::mutex::scoped_lock l( m_Mutex );
+		m_schedulingPolicy = policy;
+		m_schedulingPriority = priority;
+	}
+	applyThreadSettings();
+}
+
+
+std::string EventQueue::getThreadSettingsReport() const
+{
+	boost::mutex::scoped_lock l( const_cast< boost::mutex& >( m_Mutex ) );
+	return m_threadSettingsReport;
+}
+
+
+void EventQueue::applyThreadSettings()
+{
+	// the settings may be changed from other threads
+	std::vector< int > cpuAffinity;
+	SchedulingPolicy schedulingPolicy;
+	int schedulingPriority;
+	{
+		boost::mutex::scoped_lock l( m_Mutex );
+		cpuAffinity = m_cpuAffinity;
+		schedulingPolicy = m_schedulingPolicy;
+		schedulingPriority = m_schedulingPriority;
+	}
+
+	std::ostringstream report;
+	for ( unsigned i = 0; i < m_threads.size(); i++ )
+	{
+		report << ( i ? "; " : "" ) << "thread " << i << ":";
+
+		if ( cpuAffinity.empty() )
+			report << " default affinity";
+		else
+		{
+			report << " affinity";
+			for ( std::vector< int >::const_iterator it = cpuAffinity.begin(); it != cpuAffinity.end(); it++ )
+				report << ( it == cpuAffinity.begin() ? " " : "," ) << *it;
+
+#ifdef __linux__
+			cpu_set_t cpus;
+			CPU_ZERO( &cpus );
+			for ( std::vector< int >::const_iterator it = cpuAffinity.begin(); it != cpuAffinity.end(); it++ )
+				if ( *it >= 0 && *it < CPU_SETSIZE )
+					CPU_SET( *it, &cpus );
+
+			int error = pthread_setaffinity_np( m_threads[ i ]->native_handle(), sizeof( cpus ), &cpus );
+			report << ( error ? " failed (" + std::string( std::strerror( error ) ) + ")" : " applied" );
+#else
+			report << " not supported";
+#endif
+		}
+
+		if ( schedulingPolicy == scheduling_default )
+			report << ", default scheduling";
+		else
+		{
+			report << ( schedulingPolicy == scheduling_fifo ? ", SCHED_FIFO" : ", SCHED_RR" ) << " priority " << schedulingPriority;
+
+#ifdef __linux__
+			sched_param param;
+			std::memset( &param, 0, sizeof( param ) );
+			param.sched_priority = schedulingPriority;
+
+			int error = pthread_setschedparam( m_threads[ i ]->native_handle(), 
+				schedulingPolicy == scheduling_fifo ? SCHED_FIFO : SCHED_RR, &param );
+			report << ( error ? " failed (" + std::string( std::strerror( error ) ) + ")" : " applied" );
+#else
+			report << " not supported";
+#endif
+		}
+	}
+
+	LOG4CPP_INFO( logger, "Event queue thread settings: " << report.str() );
+
+	boost::mutex::scoped_lock l( m_Mutex );
+	m_threadSettingsReport = report.str();
 }
 
 
@@ -100,6 +438,7 @@ void EventQueue::start()
 	// tell thread to start
 	boost::mutex::scoped_lock l( m_Mutex );
 	m_State = state_running;
+	m_bRunning.store( true, boost::memory_order_release );
 	m_NewEventCondition.notify_all();
 }
 
@@ -113,8 +452,12 @@ void EventQueue::stop()
 	{
 		// tell thread to stop
 		m_State = state_stopping;
+		m_bRunning.store( false, boost::memory_order_release );
 		m_NewEventCondition.notify_all();
 
+		// blocked producers must not wait for a stopped queue
+		m_SpaceCondition.notify_all();
+
 		// wait until thread has actually stopped
 		while ( m_State != state_stopped )
 			m_NewEventCondition.wait( l );
@@ -124,76 +467,319 @@ void EventQueue::stop()
 }
 
 
-void EventQueue::queue( std::vector< QueueData >& events )
+void EventQueue::startShared()
 {
-	boost::mutex::scoped_lock l( m_Mutex );
+	boost::mutex::scoped_lock l( m_sharedStartMutex );
+	if ( m_nSharedStarts++ == 0 )
+		start();
+}
+
+
+void EventQueue::stopShared()
+{
+	boost::mutex::scoped_lock l( m_sharedStartMutex );
+	if ( m_nSharedStarts == 0 )
+		return;
+
+	if ( --m_nSharedStarts == 0 )
+		stop();
+	else
+		LOG4CPP_DEBUG( logger, "Event queue keeps running for " << m_nSharedStarts << " other user(s)" );
+}
+
+
+void EventQueue::queue( const std::vector< QueueData >& events )
+{
+	// convert to a chain of records, skipping events without payload
+	EventRecord* pFirst = 0;
+	EventRecord** ppLast = &pFirst;
+	for ( std::vector< QueueData >::const_iterator pos = events.begin(); pos != events.end(); pos++ )
+		if ( pos->event )
+		{
+			*ppLast = createEvent( pos->pReceiverInfo, pos->event, pos->priority, pos->rank );
+			ppLast = &(*ppLast)->pNext;
+		}
+
+	queue( pFirst );
+}
 
-	std::vector<QueueData>::iterator pos = events.begin();
-	std::vector<QueueData>::iterator end = events.end();
 
-	LOG4CPP_DEBUG( eventLogger, "Received " << events.size() << " events: enqueueing." );
+void EventQueue::queue( EventRecord* pEvents )
+{
+	if ( !pEvents )
+		return;
 
-	for ( ; pos != end; pos++ ) {
+	const unsigned long long queueTime( Measurement::now() );
 
+	// reverse the chain, as the ingress buffer has the newest event on top
+	EventRecord* pOldest = pEvents;
+	EventRecord* pNewest = 0;
+	while ( pEvents )
+	{
 		LOG4CPP_DEBUG( eventLogger, "Queueing event to port "
-			<< ( pos->pReceiverInfo ? pos->pReceiverInfo->pPort->fullName() : "(unknown)" ) 
-			<< ", priority=" << pos->priority );
+			<< ( pEvents->pReceiverInfo ? pEvents->pReceiverInfo->pPort->fullName() : "(unknown)" ) 
+			<< ", priority=" << pEvents->priority << ", rank=" << pEvents->rank );
+
+		ReceiverInfo* pInfo = pEvents->pReceiverInfo;
+		if ( pInfo )
+		{
+			// wait for full receivers that want to slow down their producers
+			if ( pInfo->overflowPolicy == overflow_block_producer && pInfo->nMaxQueueLength > 0 &&
+				pInfo->nQueuedEvents >= pInfo->nMaxQueueLength && !g_pDispatchingQueue.get() )
+				waitForSpace( pInfo );
+
+			// update statistics
+			pInfo->pPort->getComponent().addQueuedEvents( 1 );
+			int nQueued = pInfo->nQueuedEvents.fetch_add( 1, boost::memory_order_relaxed ) + 1;
+			int nHighWaterMark = pInfo->nHighWaterMark.load( boost::memory_order_relaxed );
+			while ( nQueued > nHighWaterMark && 
+				!pInfo->nHighWaterMark.compare_exchange_weak( nHighWaterMark, nQueued, boost::memory_order_relaxed ) )
+				;
+			pInfo->nEnqueued.fetch_add( 1, boost::memory_order_relaxed );
+			EventTracer::trace( EventTracer::trace_enqueue, *pInfo->pPort, queueTime );
+		}
+		pEvents->queueTime = queueTime;
+
+		EventRecord* pNext = pEvents->pNext;
+		pEvents->pNext = pNewest;
+		pNewest = pEvents;
+		pEvents = pNext;
+	}
+
+	// push the events to the ingress buffer without locking
+	EventRecord* pHead = m_pIngress.load( boost::memory_order_relaxed );
+	do
+		pOldest->pNext = pHead;
+	while ( !m_pIngress.compare_exchange_weak( pHead, pNewest, boost::memory_order_seq_cst, boost::memory_order_relaxed ) );
 
-		// sort event into queue
-		if ( m_Queue.empty() )
-			m_Queue.push_back( *pos );
+	if ( !m_bRunning.load( boost::memory_order_acquire ) )
+	{
+		// Patrick Maier: Prevents the queue to be filled up when the receiving thread is paused (.NET, Java, etc.)
+		boost::mutex::scoped_lock l( m_Mutex );
+		if ( m_State == state_running )
+			m_NewEventCondition.notify_all();
 		else
-			// adding an event to the back will be a common case
-			if ( m_Queue.back().priority <= pos->priority )
-				m_Queue.push_back( *pos );
-			else
-			{
-				// ... as will be adding near the front
-				QueueType::iterator it = m_Queue.begin();
-				while ( it->priority < pos->priority )
-					it++;
-				m_Queue.insert( it, *pos );
-			}
+			drainIngress();
+	}
+	else if ( pHead == 0 && m_nWaitingThreads.load( boost::memory_order_seq_cst ) )
+	{
+		// Only wake dispatching threads that sleep. If the buffer was not empty, the producer of the
+		// first events in it takes care of that. A thread about to sleep announces this in 
+		// m_nWaitingThreads before it checks the buffer again, so it either sees these events or is
+		// counted here. Taking the mutex ensures that it has started waiting before it is notified.
+		boost::mutex::scoped_lock l( m_Mutex );
+		m_NewEventCondition.notify_all();
+	}
+}
+
+
+EventQueue::EventRecord* EventQueue::allocateEvent()
+{
+	EventRecord* pRecord;
+	if ( m_freeEvents.pop( pRecord ) )
+		return pRecord;
+
+	boost::mutex::scoped_lock l( m_slabMutex );
+
+	// another thread may have allocated a slab in the meantime
+	if ( m_freeEvents.pop( pRecord ) )
+		return pRecord;
+
+	LOG4CPP_DEBUG( logger, "Allocating " << g_eventSlabSize << " event records" );
+	boost::shared_array< EventRecord > slab( new EventRecord[ g_eventSlabSize ] );
+	m_slabs.push_back( slab );
+
+	for ( std::size_t i = 1; i < g_eventSlabSize; i++ )
+		m_freeEvents.push( &slab[ i ] );
+	return &slab[ 0 ];
+}
+
+
+void EventQueue::releaseEvent( EventRecord* pRecord )
+{
+	pRecord->clearPayload();
+	m_freeEvents.push( pRecord );
+}
+
 
-		if ( pos->pReceiverInfo )
-			pos->pReceiverInfo->nQueuedEvents++;
+void EventQueue::waitForSpace( ReceiverInfo* pReceiverInfo )
+{
+	LOG4CPP_TRACE( eventLogger, "Blocking producer of " << pReceiverInfo->pPort->fullName() );
+
+	boost::mutex::scoped_lock l( m_Mutex );
+	while ( m_State == state_running && pReceiverInfo->nQueuedEvents >= pReceiverInfo->nMaxQueueLength )
+		m_SpaceCondition.wait( l );
+}
+
+
+void EventQueue::drainIngress()
+{
+	// take all events at once
+	EventRecord* pEvents = m_pIngress.exchange( 0, boost::memory_order_acquire );
+	if ( !pEvents )
+		return;
+
+	// reverse the list to get the events in the order they were queued
+	EventRecord* pOrdered = 0;
+	while ( pEvents )
+	{
+		EventRecord* pNext = pEvents->pNext;
+		pEvents->pNext = pOrdered;
+		pOrdered = pEvents;
+		pEvents = pNext;
 	}
 
-	// Patrick Maier: Prevents the queue to be filled up when the receiving thread is paused (.NET, Java, etc.)
-	// remove events from the queue if it is too long
-	// just to be sure that there is something
-	if ( !m_Queue.empty() ) {
-			while ( m_Queue.front().pReceiverInfo && m_Queue.front().pReceiverInfo->nMaxQueueLength > 0 &&
-				m_Queue.front().pReceiverInfo->nQueuedEvents > m_Queue.front().pReceiverInfo->nMaxQueueLength )
+	// sort events into queue
+	while ( pOrdered )
+	{
+		EventRecord* pRecord = pOrdered;
+		pOrdered = pOrdered->pNext;
+		pRecord->pNext = 0;
+
+		ReceiverInfo* pInfo = pRecord->pReceiverInfo;
+		if ( pInfo )
+		{
+			// apply the overflow policy of the receiver
+			int nBound = pInfo->overflowPolicy == overflow_conflate ? 1 : pInfo->nMaxQueueLength;
+			if ( nBound > 0 && static_cast< int >( pInfo->pendingEvents.size() ) >= nBound )
 			{
-				// limit number of "events dropped" messages in WARN level
-				static unsigned nDropMessages = 0;
-				static Measurement::Timestamp lastDropMessageTime = 0;
-				
-				if ( Measurement::now() > lastDropMessageTime + g_eventsDroppedMessageInterval )
+				if ( pInfo->overflowPolicy == overflow_drop_newest )
 				{
-					LOG4CPP_WARN( eventLogger, "Queue too long, dropping event for "
-						<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" )
-						<< " (skipped " << nDropMessages << " messages)" );
-					nDropMessages = 0;
-					lastDropMessageTime = Measurement::now();
+					reportDrop( pInfo );
+					pInfo->nQueuedEvents--;
+					pInfo->pPort->getComponent().addQueuedEvents( -1 );
+					releaseEvent( pRecord );
+					continue;
 				}
-				else
+
+				while ( static_cast< int >( pInfo->pendingEvents.size() ) >= nBound )
 				{
-					nDropMessages++;
-					LOG4CPP_DEBUG( eventLogger, "Queue too long, dropping event for "
-						<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" ) );
+					reportDrop( pInfo );
+					cancelEvent( pInfo->pendingEvents.front() );
 				}
-
-				if ( m_Queue.front().pReceiverInfo )
-					m_Queue.front().pReceiverInfo->nQueuedEvents--;
-				m_Queue.pop_front();
 			}
+
+			if ( pInfo->pendingEvents.full() )
+				pInfo->pendingEvents.set_capacity( std::max< std::size_t >( 8, 2 * pInfo->pendingEvents.capacity() ) );
+			pInfo->pendingEvents.push_back( pRecord );
+		}
+
+		pRecord->sequence = m_nextSequence++;
+		m_Queue.push_back( pRecord );
+		std::push_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
 	}
+}
 
-	// notify waiting thread
-	if ( m_State == state_running )
-		m_NewEventCondition.notify_all();
+
+void EventQueue::reportDrop( ReceiverInfo* pReceiverInfo )
+{
+	pReceiverInfo->nDropped.fetch_add( 1, boost::memory_order_relaxed );
+	if ( EventTracer::isEnabled() )
+		EventTracer::trace( EventTracer::trace_drop, *pReceiverInfo->pPort, Measurement::now() );
+
+	// limit number of "events dropped" messages in WARN level
+	static unsigned nDropMessages = 0;
+	static Measurement::Timestamp lastDropMessageTime = 0;
+	
+	if ( Measurement::now() > lastDropMessageTime + g_eventsDroppedMessageInterval )
+	{
+		LOG4CPP_WARN( eventLogger, "Queue too long, dropping event for "
+			<< pReceiverInfo->pPort->fullName() << " (skipped " << nDropMessages << " messages)" );
+		nDropMessages = 0;
+		lastDropMessageTime = Measurement::now();
+	}
+	else
+	{
+		nDropMessages++;
+		LOG4CPP_DEBUG( eventLogger, "Queue too long, dropping event for " << pReceiverInfo->pPort->fullName() );
+	}
+}
+
+
+bool EventQueue::discardExpired( unsigned long long& now )
+{
+	EventRecord* pFront = m_Queue.front();
+	ReceiverInfo* pInfo = pFront->pReceiverInfo;
+	if ( !pInfo || !pInfo->maxAge )
+		return false;
+
+	if ( !now )
+		now = m_ageClock ? m_ageClock() : Measurement::now();
+	if ( pFront->priority + pInfo->maxAge >= now )
+		return false;
+
+	LOG4CPP_DEBUG( eventLogger, "Discarding expired event for " << pInfo->pPort->fullName() 
+		<< ", age=" << ( now - pFront->priority ) / 1000000 << "ms" );
+	pInfo->nExpired.fetch_add( 1, boost::memory_order_relaxed );
+	EventTracer::trace( EventTracer::trace_expire, *pInfo->pPort, now );
+	releaseEvent( popFront() );
+	return true;
+}
+
+
+void EventQueue::detachEvent( EventRecord* pRecord )
+{
+	ReceiverInfo* pInfo = pRecord->pReceiverInfo;
+	if ( !pInfo )
+		return;
+
+	// usually, events are dispatched in the order they arrived
+	boost::circular_buffer< EventRecord* >& pending( pInfo->pendingEvents );
+	if ( pending.front() == pRecord )
+		pending.pop_front();
+	else if ( pending.back() == pRecord )
+		pending.pop_back();
+	else
+		pending.erase( std::find( pending.begin(), pending.end(), pRecord ) );
+
+	pInfo->nQueuedEvents--;
+	pInfo->pPort->getComponent().addQueuedEvents( -1 );
+
+	if ( pInfo->overflowPolicy == overflow_block_producer )
+		m_SpaceCondition.notify_all();
+}
+
+
+void EventQueue::cancelEvent( EventRecord* pRecord )
+{
+	detachEvent( pRecord );
+	pRecord->pReceiverInfo = 0;
+	pRecord->clearPayload();
+}
+
+
+EventQueue::ReceiverStatistics EventQueue::ReceiverInfo::getStatistics() const
+{
+	ReceiverStatistics stats;
+	stats.nQueuedEvents = nQueuedEvents.load( boost::memory_order_relaxed );
+	stats.nHighWaterMark = nHighWaterMark.load( boost::memory_order_relaxed );
+	stats.nEnqueued = nEnqueued.load( boost::memory_order_relaxed );
+	stats.nDispatched = nDispatched.load( boost::memory_order_relaxed );
+	stats.nDropped = nDropped.load( boost::memory_order_relaxed );
+	stats.nExpired = nExpired.load( boost::memory_order_relaxed );
+	stats.nDirect = nDirect.load( boost::memory_order_relaxed );
+	for ( int i = 0; i < latencyBuckets; i++ )
+		stats.latencyHistogram[ i ] = latencyHistogram[ i ].load( boost::memory_order_relaxed );
+	return stats;
+}
+
+
+EventQueue::Statistics EventQueue::getStatistics() const
+{
+	Statistics stats;
+	stats.startTime = m_statisticsStartTime.load( boost::memory_order_relaxed );
+	stats.sampleTime = Measurement::now();
+	stats.nDispatched = m_nDispatched.load( boost::memory_order_relaxed );
+	stats.dispatchTime = m_dispatchTime.load( boost::memory_order_relaxed );
+	return stats;
+}
+
+
+void EventQueue::resetStatistics()
+{
+	m_statisticsStartTime.store( Measurement::now(), boost::memory_order_relaxed );
+	m_nDispatched.store( 0, boost::memory_order_relaxed );
+	m_dispatchTime.store( 0, boost::memory_order_relaxed );
 }
 
 
@@ -202,16 +788,28 @@ void EventQueue::removeComponent( const Component* pComponent )
 	LOG4CPP_DEBUG( logger, "Removing events for component " << pComponent->getName() );
 
 	boost::mutex::scoped_lock l( m_Mutex );
+	drainIngress();
 
-	// remove all events that belong to the component
-	for ( QueueType::iterator it = m_Queue.begin(); it != m_Queue.end(); )
-		if ( it->pReceiverInfo && &it->pReceiverInfo->pPort->getComponent() == pComponent )
-		{
-			it->pReceiverInfo->nQueuedEvents--;
-			it = m_Queue.erase( it );
-		}
-		else
-			it++;
+	// cancel the events queued for the ports of the component, they are discarded when they reach the front of the queue
+	const Component::PortMap& ports( pComponent->getPorts() );
+	for ( Component::PortMap::const_iterator itPort = ports.begin(); itPort != ports.end(); itPort++ )
+	{
+		const Port::ReceiverInfoList& receivers( itPort->second->getReceiverInfos() );
+		for ( Port::ReceiverInfoList::const_iterator it = receivers.begin(); it != receivers.end(); it++ )
+			while ( !(*it)->pendingEvents.empty() )
+				cancelEvent( (*it)->pendingEvents.front() );
+	}
+}
+
+
+EventQueue::EventRecord* EventQueue::popFront()
+{
+	EventRecord* pRecord = m_Queue.front();
+	std::pop_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
+	m_Queue.pop_back();
+
+	detachEvent( pRecord );
+	return pRecord;
 }
 
 
@@ -220,14 +818,11 @@ void EventQueue::clear()
 	LOG4CPP_DEBUG( logger, "Removing all events from queue" );
 
 	boost::mutex::scoped_lock l( m_Mutex );
-
-	// decrement all event counters
-	for ( QueueType::iterator it = m_Queue.begin(); it != m_Queue.end(); it++ )
-		if ( it->pReceiverInfo )
-			it->pReceiverInfo->nQueuedEvents--;
+	drainIngress();
 
 	// remove all events
-	m_Queue.clear();
+	while ( !m_Queue.empty() )
+		releaseEvent( popFront() );
 
 	LOG4CPP_DEBUG( logger, "All events removed" );
 }
@@ -239,136 +834,437 @@ void EventQueue::dispatchNow()
 	while ( true )
 	{
 		// need this type of logic, as boost is very strict with locking...
-		EventType dispatchEvent;
-		ReceiverInfo* pReceiverInfo( 0 );
-
+		EventRecord* pRecord;
+		unsigned long long now = 0;
 		{
 			// lock the mutex
 			boost::mutex::scoped_lock l( m_Mutex );
+			drainIngress();
+
+			// discard events that are too old
+			while ( !m_Queue.empty() && discardExpired( now ) )
+				;
 
 			if ( m_Queue.empty() )
 				return;
 
 			// fetch and remove first event from the queue
 			LOG4CPP_TRACE( eventLogger, "dispatchNow(): dispatching event for " 
-				<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" ) );
+				<< ( m_Queue.front()->pReceiverInfo ? m_Queue.front()->pReceiverInfo->pPort->fullName() : "(unknown)" ) );
 
-			if ( m_Queue.front().pReceiverInfo && m_Queue.front().pReceiverInfo->nMaxQueueLength > 0 &&
-				m_Queue.front().pReceiverInfo->nQueuedEvents > m_Queue.front().pReceiverInfo->nMaxQueueLength )
-			{
-				// limit number of "events dropped" messages in WARN level
-				static unsigned nDropMessages = 0;
-				static Measurement::Timestamp lastDropMessageTime = 0;
-				
-				if ( Measurement::now() > lastDropMessageTime + g_eventsDroppedMessageInterval )
-				{
-					LOG4CPP_WARN( eventLogger, "Queue too long, dropping event for "
-						<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" )
-						<< " (skipped " << nDropMessages << " messages)" );
-					nDropMessages = 0;
-					lastDropMessageTime = Measurement::now();
-				}
-				else
-				{
-					nDropMessages++;
-					LOG4CPP_DEBUG( eventLogger, "Queue too long, dropping event for "
-						<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" ) );
-				}
-			}
-			else
-			{
-				pReceiverInfo = m_Queue.front().pReceiverInfo;
-				dispatchEvent = m_Queue.front().event;
-			}
-			
-			if ( m_Queue.front().pReceiverInfo )
-				m_Queue.front().pReceiverInfo->nQueuedEvents--;
-			m_Queue.pop_front();
+			pRecord = popFront();
 		}
 
-		// dispatch the event
-		if ( dispatchEvent )
+		// dispatch the event, unless it has been dropped
+		if ( pRecord->hasPayload() )
+			invokeEvent( *pRecord );
+		releaseEvent( pRecord );
+	}
+}
+
+
+void EventQueue::invokeEvent( EventRecord& event )
+{
+	ReceiverInfo* pReceiverInfo = event.pReceiverInfo;
+	const unsigned long long startTime( Measurement::now() );
+
+	// direct dispatch must not re-enter the receiver from within its handler, nor may parallel pulls wait for it
+	ReceiverInfo::MutexType* pMutex = pReceiverInfo ? pReceiverInfo->pMutex : 0;
+	Component::LockedScope locked( pMutex );
+
+	try
+	{
+		if ( pMutex )
 		{
+			// lock the mutex
+			ReceiverInfo::MutexType::scoped_lock l( *pMutex );
+			advancePushGeneration( pReceiverInfo );
+			event.invoke();
+		}
+		else
+		{
+			// no mutex
+			advancePushGeneration( pReceiverInfo );
+			event.invoke();
+		}
+	}
+	catch ( ... )
+	{
+		reportException( pReceiverInfo );
+	}
+
+	recordDispatch( pReceiverInfo, event.queueTime, startTime );
+}
+
+
+void EventQueue::invokeGroup( EventRecord** pFirst, EventRecord** pLast )
+{
+	ReceiverInfo* pReceiverInfo = (*pFirst)->pReceiverInfo;
+	Component& rComponent( pReceiverInfo->pPort->getComponent() );
+	LOG4CPP_TRACE( eventLogger, "delivering " << ( pLast - pFirst ) << " events to " << rComponent.getName() );
+
+	ReceiverInfo::MutexType* pMutex = pReceiverInfo->pMutex;
+	Component::LockedScope locked( pMutex );
+
+	{
+		// lock the component once for all events
+		boost::scoped_ptr< ReceiverInfo::MutexType::scoped_lock > pLock;
+		if ( pMutex )
+			pLock.reset( new ReceiverInfo::MutexType::scoped_lock( *pMutex ) );
+
+		try
+		{
+			rComponent.beginEventBatch();
+		}
+		catch ( ... )
+		{
+			reportException( pReceiverInfo );
+		}
+
+		for ( EventRecord** p = pFirst; p != pLast; p++ )
+		{
+			const unsigned long long startTime( Measurement::now() );
 			try
 			{
-				if ( pReceiverInfo && pReceiverInfo->pMutex )
-				{
-					// lock the mutex
-					ReceiverInfo::MutexType::scoped_lock l( *pReceiverInfo->pMutex );
-					dispatchEvent();
-				}
-				else
-					// no mutex
-					dispatchEvent();
-			}
-			catch ( const Ubitrack::Util::Exception& e )
-			{
-				LOG4CPP_WARN( eventLogger, e );
+				advancePushGeneration( (*p)->pReceiverInfo );
+				(*p)->invoke();
 			}
-			catch ( const std::exception& e )
+			catch ( ... )
 			{
-				LOG4CPP_WARN( eventLogger, "Caught std::exception: " << e.what() );
+				reportException( (*p)->pReceiverInfo );
 			}
-			catch ( ... )
+			recordDispatch( (*p)->pReceiverInfo, (*p)->queueTime, startTime );
+		}
+
+		try
+		{
+			rComponent.endEventBatch();
+		}
+		catch ( ... )
+		{
+			reportException( pReceiverInfo );
+		}
+	}
+}
+
+
+void EventQueue::groupBatch( std::vector< EventRecord* >& batch )
+{
+	// stable grouping by component in the order of first appearance, batches are small
+	for ( std::size_t i = 1; i < batch.size(); i++ )
+	{
+		const Component* pComponent( receivingComponent( batch[ i - 1 ] ) );
+		for ( std::size_t j = i; pComponent && j < batch.size(); j++ )
+			if ( receivingComponent( batch[ j ] ) == pComponent )
 			{
-				LOG4CPP_WARN( eventLogger, "Caught unknown exception" );
+				std::rotate( batch.begin() + i, batch.begin() + j, batch.begin() + j + 1 );
+				break;
 			}
+	}
+}
+
+
+void EventQueue::reportException( ReceiverInfo* pReceiverInfo )
+{
+	try
+	{
+		throw;
+	}
+	catch ( const Ubitrack::Util::Exception& e )
+	{
+		LOG4CPP_WARN( eventLogger, e );
+	}
+	catch ( const std::exception& e )
+	{
+		LOG4CPP_WARN( eventLogger, "Caught std::exception: " << e.what() << " occurred when pushing on port "
+			<< ( pReceiverInfo ? pReceiverInfo->pPort->fullName() : "(unknown)" ) );
+	}
+	catch ( ... )
+	{
+		LOG4CPP_WARN( eventLogger, "Caught unknown exception" << " when pushing on port "
+			<< ( pReceiverInfo ? pReceiverInfo->pPort->fullName() : "(unknown)" ) );
+	}
+}
+
+
+void EventQueue::recordDispatch( ReceiverInfo* pReceiverInfo, unsigned long long queueTime, unsigned long long startTime )
+{
+	const unsigned long long endTime( Measurement::now() );
+
+	m_nDispatched.fetch_add( 1, boost::memory_order_relaxed );
+	m_dispatchTime.fetch_add( endTime - startTime, boost::memory_order_relaxed );
+
+	if ( pReceiverInfo )
+	{
+		pReceiverInfo->nDispatched.fetch_add( 1, boost::memory_order_relaxed );
+
+		unsigned long long waitTime = ( startTime > queueTime ? startTime - queueTime : 0 ) / 1000;
+		int bucket = 0;
+		for ( ; waitTime && bucket < latencyBuckets - 1; waitTime >>= 1 )
+			bucket++;
+		pReceiverInfo->latencyHistogram[ bucket ].fetch_add( 1, boost::memory_order_relaxed );
+
+		EventTracer::trace( EventTracer::trace_dispatch, *pReceiverInfo->pPort, startTime, endTime - startTime,
+			startTime > queueTime ? startTime - queueTime : 0 );
+	}
+}
+
+
+void EventQueue::setMaxDirectDepth( unsigned nDepth )
+{
+	m_nMaxDirectDepth = nDepth;
+}
+
+
+void EventQueue::setAgeClock( const ClockType& clock )
+{
+	boost::mutex::scoped_lock l( m_Mutex );
+	m_ageClock = clock;
+}
+
+
+unsigned EventQueue::getMaxDirectDepth() const
+{
+	return m_nMaxDirectDepth;
+}
+
+
+bool EventQueue::enterDirectDispatch( ReceiverInfo& rReceiver, unsigned long long& startTime )
+{
+	// the event must not overtake events queued for the receiver or for other ports of its component
+	if ( !m_bRunning.load( boost::memory_order_acquire ) || rReceiver.pPort->getComponent().getQueuedEvents() != 0 )
+		return false;
+
+	DirectDispatchState* pState = g_pDirectDispatchState.get();
+	if ( !pState )
+	{
+		pState = new DirectDispatchState;
+		g_pDirectDispatchState.reset( pState );
+	}
+
+	// limit the recursion
+	if ( pState->nDepth >= m_nMaxDirectDepth )
+		return false;
+
+	if ( rReceiver.pMutex )
+	{
+		// the mutex is recursive, so check that the receiver is not handling an event in this thread already
+		if ( Component::isLockedByThisThread( rReceiver.pMutex ) )
+			return false;
+
+		// do not wait for receivers busy in other threads
+		if ( !rReceiver.pMutex->try_lock() )
+			return false;
+
+		Component::beginLocked( rReceiver.pMutex );
+	}
+
+	advancePushGeneration( &rReceiver );
+	pState->nDepth++;
+	startTime = Measurement::now();
+	return true;
+}
+
+
+void EventQueue::leaveDirectDispatch( ReceiverInfo& rReceiver, unsigned long long startTime )
+{
+	DirectDispatchState* pState = g_pDirectDispatchState.get();
+	pState->nDepth--;
+
+	if ( rReceiver.pMutex )
+	{
+		Component::endLocked();
+		rReceiver.pMutex->unlock();
+	}
+
+	rReceiver.nDirect.fetch_add( 1, boost::memory_order_relaxed );
+	recordDispatch( &rReceiver, startTime, startTime );
+}
+
+
+bool EventQueue::hasDispatchableEvent() const
+{
+	// the heap is not sorted beyond its front, so an event found here may still be blocked by an 
+	// earlier event of its group. The woken thread then just waits again.
+	const std::vector< int > noBlockedGroups;
+	for ( QueueType::const_iterator it = m_Queue.begin(); it != m_Queue.end(); it++ )
+	{
+		int group = (*it)->pReceiverInfo ? (*it)->pReceiverInfo->pPort->getComponent().getEventGroup() : -1;
+		if ( (*it)->hasPayload() && mayDispatch( **it, group, noBlockedGroups ) )
+			return true;
+	}
+
+	return false;
+}
+
+
+bool EventQueue::mayDispatch( const EventRecord& event, int group, const std::vector< int >& blockedGroups ) const
+{
+	// an earlier event of the same group is waiting
+	if ( std::find( blockedGroups.begin(), blockedGroups.end(), group ) != blockedGroups.end() )
+		return false;
+
+	for ( InFlightList::const_iterator it = m_inFlight.begin(); it != m_inFlight.end(); it++ )
+	{
+		// the receiving component is busy
+		if ( event.pReceiverInfo && event.pReceiverInfo->pMutex && event.pReceiverInfo->pMutex == it->pMutex )
+			return false;
+
+		// events of different priority on a dependent path
+		if ( it->group == group && ( it->priority != event.priority || it->rank != event.rank ) )
+			return false;
+	}
+
+	return true;
+}
+
+
+EventQueue::EventRecord* EventQueue::takeEvent()
+{
+	const bool bParallel = m_nThreads > 1;
+	std::vector< int > blockedGroups;
+	EventRecord* pResult = 0;
+	unsigned long long now = 0;
+
+	drainIngress();
+
+	while ( !pResult && !m_Queue.empty() )
+	{
+		EventRecord* pFront = m_Queue.front();
+
+		// discard dropped events
+		if ( !pFront->hasPayload() )
+		{
+			releaseEvent( popFront() );
+			continue;
+		}
+
+		// discard events that are too old
+		if ( discardExpired( now ) )
+			continue;
+
+		int group = pFront->pReceiverInfo ? pFront->pReceiverInfo->pPort->getComponent().getEventGroup() : -1;
+		if ( bParallel && !mayDispatch( *pFront, group, blockedGroups ) )
+		{
+			// keep the event for later and block all following events of the same group
+			blockedGroups.push_back( group );
+			m_deferred.push_back( pFront );
+			std::pop_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
+			m_Queue.pop_back();
+			continue;
+		}
+
+		LOG4CPP_DEBUG( eventLogger, "dispatching event for "
+			<< ( pFront->pReceiverInfo ? pFront->pReceiverInfo->pPort->fullName() : "(unknown)" ) );
+
+		pResult = popFront();
+
+		if ( bParallel )
+		{
+			InFlightEvent inFlight;
+			inFlight.group = group;
+			inFlight.priority = pResult->priority;
+			inFlight.rank = pResult->rank;
+			inFlight.sequence = pResult->sequence;
+			inFlight.pMutex = pResult->pReceiverInfo ? pResult->pReceiverInfo->pMutex : 0;
+			m_inFlight.push_back( inFlight );
+		}
+	}
+
+	// put deferred events back into the queue
+	for ( QueueType::iterator it = m_deferred.begin(); it != m_deferred.end(); it++ )
+	{
+		m_Queue.push_back( *it );
+		std::push_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
+	}
+	m_deferred.clear();
+
+	return pResult;
+}
+
+
+void EventQueue::takeBatch( std::vector< EventRecord* >& batch )
+{
+	EventRecord* pFirst = takeEvent();
+	if ( !pFirst )
+		return;
+	batch.push_back( pFirst );
+
+	// add following events with the same priority and rank. Events queued by their handlers have
+	// a higher rank or sequence number, so they would have been dispatched afterwards anyway.
+	const Component* pComponent( receivingComponent( pFirst ) );
+	unsigned long long now = 0;
+	while ( batch.size() < m_nBatchSize && !m_Queue.empty() )
+	{
+		EventRecord* pFront = m_Queue.front();
+		if ( pFront->priority != pFirst->priority || pFront->rank != pFirst->rank )
+			break;
+
+		// discard dropped events
+		if ( !pFront->hasPayload() )
+		{
+			releaseEvent( popFront() );
+			continue;
 		}
+
+		// discard events that are too old
+		if ( discardExpired( now ) )
+			continue;
+
+		// with several threads, other components may be handled in parallel. Only the first event is
+		// registered in m_inFlight, so the batch must not contain events for other components, even
+		// if they have no mutex. Their events are skipped to collect all events of the timestamp for
+		// the component, see setGroupedDelivery().
+		if ( m_nThreads > 1 && receivingComponent( pFront ) != pComponent )
+		{
+			if ( !pComponent )
+				break;
+
+			m_deferred.push_back( pFront );
+			std::pop_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
+			m_Queue.pop_back();
+			continue;
+		}
+
+		batch.push_back( popFront() );
 	}
+
+	// put skipped events back into the queue
+	for ( QueueType::iterator it = m_deferred.begin(); it != m_deferred.end(); it++ )
+	{
+		m_Queue.push_back( *it );
+		std::push_heap( m_Queue.begin(), m_Queue.end(), LaterEvent() );
+	}
+	m_deferred.clear();
+
+	if ( m_bGroupedDelivery && batch.size() > 1 )
+		groupBatch( batch );
 }
 
 
 void EventQueue::threadFunction()
 {
-	// Note: In case we want to extend this to multiple threads later, we need to make sure that only
-	// events of SAME PRIORITY are processed simultaneously, unless they are on unrelated paths!
+	// Note: With multiple threads, only events of SAME PRIORITY are processed simultaneously,
+	// unless they are on unrelated paths (different event groups), see mayDispatch().
+
+	// producers running in this thread must never block
+	g_pDispatchingQueue.reset( this );
+
+	std::vector< EventRecord* > batch;
 	
 	while ( true )
 	{
 		// need this type of logic, as boost is very strict with locking...
-		EventType dispatchEvent;
-		ReceiverInfo* pReceiverInfo( 0 );		
+		batch.clear();
 		{
 			// lock the mutex
 			boost::mutex::scoped_lock l( m_Mutex );
 
-			if ( m_State == state_running && !m_Queue.empty() )
+			if ( m_State == state_running && ( takeBatch( batch ), !batch.empty() ) )
 			{
-				// dispatch an event
-				LOG4CPP_DEBUG( eventLogger, "dispatching event for "
-					<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" ) );
-					
-				if ( m_Queue.front().pReceiverInfo && m_Queue.front().pReceiverInfo->nMaxQueueLength > 0 &&
-					m_Queue.front().pReceiverInfo->nQueuedEvents > m_Queue.front().pReceiverInfo->nMaxQueueLength )
-				{
-					// limit number of "events dropped" messages in WARN level
-					static unsigned nDropMessages = 0;
-					static Measurement::Timestamp lastDropMessageTime = 0;
-					
-					if ( Measurement::now() > lastDropMessageTime + g_eventsDroppedMessageInterval )
-					{
-						LOG4CPP_WARN( eventLogger, "Queue too long, dropping event for "
-							<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" )
-							<< " (skipped " << nDropMessages << " messages)" );
-						nDropMessages = 0;
-						lastDropMessageTime = Measurement::now();
-					}
-					else
-					{
-						nDropMessages++;
-						LOG4CPP_DEBUG( eventLogger, "Queue too long, dropping event for "
-							<< ( m_Queue.front().pReceiverInfo ? m_Queue.front().pReceiverInfo->pPort->fullName() : "(unknown)" ) );
-					}
-				}
-				else
-				{
-					pReceiverInfo = m_Queue.front().pReceiverInfo;
-					dispatchEvent = m_Queue.front().event;
-				}
-					
-				if ( m_Queue.front().pReceiverInfo )
-					m_Queue.front().pReceiverInfo->nQueuedEvents--;
-				m_Queue.pop_front();
+				// dispatch the events below, and let a waiting thread take the events for other components
+				if ( m_nThreads > 1 && m_nWaitingThreads.load( boost::memory_order_relaxed ) && hasDispatchableEvent() )
+					m_NewEventCondition.notify_one();
 			}
 			else if ( m_State == state_end )
 			{
@@ -376,7 +1272,7 @@ void EventQueue::threadFunction()
 				// end this thread
 				return;
 			}
-			else if ( m_State == state_stopping )
+			else if ( m_State == state_stopping && m_inFlight.empty() )
 			{
 				LOG4CPP_DEBUG( logger, "Ending other queue threads");
 				// stop and wait for something to happen
@@ -387,38 +1283,56 @@ void EventQueue::threadFunction()
 			}
 			else
 			{				
-				// wait for something to happen
-				m_NewEventCondition.wait( l );
+				// wait for something to happen, unless events were queued after takeBatch(), see queue()
+				m_nWaitingThreads.fetch_add( 1, boost::memory_order_seq_cst );
+				if ( m_State != state_running || !m_pIngress.load( boost::memory_order_seq_cst ) )
+					m_NewEventCondition.wait( l );
+				m_nWaitingThreads.fetch_sub( 1, boost::memory_order_relaxed );
 			}
 		}
 
-		// dispatch the event if one was taken from the queue
-		if ( dispatchEvent )
+		// dispatch the events taken from the queue
+		if ( !batch.empty() )
 		{
-			try
+			if ( m_bGroupedDelivery )
 			{
-				if ( pReceiverInfo && pReceiverInfo->pMutex )
+				// deliver the events of each component as one group
+				for ( std::size_t i = 0; i < batch.size(); )
 				{
-					// lock the mutex
-					ReceiverInfo::MutexType::scoped_lock l( *pReceiverInfo->pMutex );
-					dispatchEvent();
+					const Component* pComponent( receivingComponent( batch[ i ] ) );
+					std::size_t j = i + 1;
+					while ( pComponent && j < batch.size() && receivingComponent( batch[ j ] ) == pComponent )
+						j++;
+
+					if ( pComponent )
+						invokeGroup( &batch[ i ], &batch[ 0 ] + j );
+					else
+						invokeEvent( *batch[ i ] );
+					i = j;
 				}
-				else
-					// no mutex
-					dispatchEvent();
-			}
-			catch ( const Ubitrack::Util::Exception& e )
-			{
-				LOG4CPP_WARN( eventLogger, e );
-			}
-			catch ( const std::exception& e )
-			{
-				LOG4CPP_WARN( eventLogger, "Caught std::exception: " << e.what() << " occurred when pushing on port " << pReceiverInfo->pPort->fullName() );
 			}
-			catch ( ... )
+			else
+				for ( std::vector< EventRecord* >::iterator it = batch.begin(); it != batch.end(); it++ )
+					invokeEvent( **it );
+
+			if ( m_nThreads > 1 )
 			{
-				LOG4CPP_WARN( eventLogger, "Caught unknown exception" << " when pushing on port " << pReceiverInfo->pPort->fullName() );
+				// other threads may wait for this batch to finish, it is registered under its first event
+				boost::mutex::scoped_lock l( m_Mutex );
+				for ( InFlightList::iterator it = m_inFlight.begin(); it != m_inFlight.end(); it++ )
+					if ( it->sequence == batch.front()->sequence )
+					{
+						m_inFlight.erase( it );
+						break;
+					}
+				if ( m_State == state_stopping )
+					m_NewEventCondition.notify_all();
+				else if ( m_nWaitingThreads )
+					m_NewEventCondition.notify_one();
 			}
+
+			for ( std::vector< EventRecord* >::iterator it = batch.begin(); it != batch.end(); it++ )
+				releaseEvent( *it );
 		}
 	}
 }
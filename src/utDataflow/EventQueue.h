@@ -32,13 +32,22 @@
 #ifndef __Ubitrack_Dataflow_EventQueue_INCLUDED__
 #define __Ubitrack_Dataflow_EventQueue_INCLUDED__
 
-#include <list>
+#include <new>
+#include <utility>
 #include <vector>
+#include <string>
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
 #include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/lockfree/stack.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/decay.hpp>
 
 #include <utDataflow.h>
 
@@ -49,6 +58,80 @@ class Port;
 class Component;
 
 
+/** \internal type-erased operations on the payload of an event record */
+struct EventPayloadOperations
+{
+	/** calls the payload */
+	void ( *invoke )( void* pStorage );
+
+	/** destroys the payload */
+	void ( *destroy )( void* pStorage );
+};
+
+
+/**
+ * \internal
+ * Stores payloads in the storage of an event record.
+ * Payloads that fit are constructed in place, larger ones are allocated on the heap.
+ */
+template< class Payload, bool bInPlace > 
+struct EventPayloadStorage;
+
+template< class Payload > 
+struct EventPayloadStorage< Payload, true >
+{
+	static void create( void* pStorage, const Payload& payload )
+	{ new ( pStorage ) Payload( payload ); }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	static void create( void* pStorage, Payload&& payload )
+	{ new ( pStorage ) Payload( std::move( payload ) ); }
+#endif
+
+	static Payload& get( void* pStorage )
+	{ return *static_cast< Payload* >( pStorage ); }
+
+	static void invoke( void* pStorage )
+	{ get( pStorage )(); }
+
+	static void destroy( void* pStorage )
+	{ get( pStorage ).~Payload(); }
+
+	static const EventPayloadOperations operations;
+};
+
+template< class Payload > 
+const EventPayloadOperations EventPayloadStorage< Payload, true >::operations = 
+	{ &EventPayloadStorage< Payload, true >::invoke, &EventPayloadStorage< Payload, true >::destroy };
+
+template< class Payload > 
+struct EventPayloadStorage< Payload, false >
+{
+	static void create( void* pStorage, const Payload& payload )
+	{ *static_cast< Payload** >( pStorage ) = new Payload( payload ); }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	static void create( void* pStorage, Payload&& payload )
+	{ *static_cast< Payload** >( pStorage ) = new Payload( std::move( payload ) ); }
+#endif
+
+	static Payload& get( void* pStorage )
+	{ return **static_cast< Payload** >( pStorage ); }
+
+	static void invoke( void* pStorage )
+	{ get( pStorage )(); }
+
+	static void destroy( void* pStorage )
+	{ delete *static_cast< Payload** >( pStorage ); }
+
+	static const EventPayloadOperations operations;
+};
+
+template< class Payload > 
+const EventPayloadOperations EventPayloadStorage< Payload, false >::operations = 
+	{ &EventPayloadStorage< Payload, false >::invoke, &EventPayloadStorage< Payload, false >::destroy };
+
+
 /**
  * @ingroup dataflow_framework
  * Event queue used for push communication in data flow networks.
@@ -60,6 +143,90 @@ public:
 	/** shortcut for type of events stored in the queue */
 	typedef boost::function< void () > EventType;
 
+	// forward declaration
+	class EventRecord;
+
+	/** what to do when an event arrives for a receiver that already has the maximum number of events queued */
+	enum OverflowPolicy
+	{
+		/** drop the oldest queued event of the receiver (default) */
+		overflow_drop_oldest,
+
+		/** drop the arriving event */
+		overflow_drop_newest,
+
+		/** block the sending thread until the receiver has space again. Event queue threads are never blocked. */
+		overflow_block_producer,
+
+		/** keep only the latest event, regardless of the maximum queue length */
+		overflow_conflate
+	};
+
+	/**
+	 * Converts a policy name as used in UTQL ("drop-oldest", "drop-newest", "block-producer", "conflate").
+	 * Throws a \c Ubitrack::Util::Exception if the name is unknown.
+	 */
+	static OverflowPolicy parseOverflowPolicy( const std::string& sName );
+
+	/** number of buckets of the queue wait time histograms */
+	enum { latencyBuckets = 24 };
+
+	/** snapshot of the statistics of one event receiver, see ReceiverInfo::getStatistics() */
+	struct ReceiverStatistics
+	{
+		/** number of events currently queued */
+		int nQueuedEvents;
+
+		/** maximum number of events that were queued at the same time */
+		int nHighWaterMark;
+
+		/** number of events queued for the receiver */
+		unsigned long long nEnqueued;
+
+		/** number of events dispatched to the receiver */
+		unsigned long long nDispatched;
+
+		/** number of events dropped because the queue of the receiver was full */
+		unsigned long long nDropped;
+
+		/** number of events discarded because they were older than the maximum age */
+		unsigned long long nExpired;
+
+		/** number of events delivered by direct dispatch without being queued, see EventQueue::dispatchDirect() */
+		unsigned long long nDirect;
+
+		/** 
+		 * Histogram of the time events waited in the queue. Bucket 0 counts events that waited 
+		 * less than 1 microsecond, bucket i events that waited between 2^(i-1) and 2^i microseconds.
+		 * The last bucket also counts all longer waits.
+		 */
+		unsigned long long latencyHistogram[ latencyBuckets ];
+	};
+
+	/** snapshot of the statistics of the whole queue, see getStatistics() */
+	struct Statistics
+	{
+		/** time when the statistics were started */
+		unsigned long long startTime;
+
+		/** time of the snapshot */
+		unsigned long long sampleTime;
+
+		/** number of dispatched events */
+		unsigned long long nDispatched;
+
+		/** total time spent in event handlers, in nanoseconds */
+		unsigned long long dispatchTime;
+
+		/** events dispatched per second since the start of the statistics */
+		double dispatchRate() const
+		{ return sampleTime > startTime ? nDispatched * 1e9 / ( sampleTime - startTime ) : 0.0; }
+
+		/** average time per dispatched event, in nanoseconds */
+		double averageDispatchTime() const
+		{ return nDispatched ? double( dispatchTime ) / nDispatched : 0.0; }
+	};
+
 	/** each event receiver must fill out one of these for queue length management, etc. */
 	struct ReceiverInfo
 	{
@@ -67,12 +234,41 @@ public:
 		typedef boost::recursive_mutex MutexType;
 
 		/** constructor */
-		ReceiverInfo( Port* _pPort, MutexType* _pMutex = 0, int _nMaxQueueLength = -1 )
+		ReceiverInfo( Port* _pPort, MutexType* _pMutex = 0, int _nMaxQueueLength = -1, OverflowPolicy _overflowPolicy = overflow_drop_oldest,
+			unsigned long long _maxAge = 0 )
 			: pPort( _pPort )
 			, pMutex( _pMutex )
 			, nMaxQueueLength( _nMaxQueueLength )
+			, overflowPolicy( _overflowPolicy )
+			, maxAge( _maxAge )
 			, nQueuedEvents( 0 )
-		{}
+			, pendingEvents( _nMaxQueueLength > 0 ? _nMaxQueueLength : 8 )
+			, nHighWaterMark( 0 )
+			, nEnqueued( 0 )
+			, nDispatched( 0 )
+			, nDropped( 0 )
+			, nExpired( 0 )
+			, nDirect( 0 )
+		{
+			for ( int i = 0; i < latencyBuckets; i++ )
+				latencyHistogram[ i ].store( 0, boost::memory_order_relaxed );
+		}
+
+		/** returns a snapshot of the statistics of this receiver. May be called from any thread. */
+		ReceiverStatistics getStatistics() const;
+
+		/** 
+		 * true if another event would be handled by the overflow policy: the queue of this receiver is
+		 * full or, with overflow_conflate, an event is pending. Other receivers with unlimited queues 
+		 * are never saturated.
+		 */
+		bool isSaturated() const
+		{
+			const int nQueued( nQueuedEvents.load( boost::memory_order_relaxed ) );
+			if ( overflowPolicy == overflow_conflate )
+				return nQueued > 0;
+			return nMaxQueueLength > 0 && nQueued >= nMaxQueueLength;
+		}
 		
 		/** pointer to receiving port */
 		Port* pPort;
@@ -82,25 +278,150 @@ public:
 		
 		/** maximum number of allowed events, negative if infinite queueing is allowed */
 		int nMaxQueueLength;
+
+		/** what to do if the queue is full */
+		OverflowPolicy overflowPolicy;
+
+		/** 
+		 * Maximum age of events in nanoseconds, 0 if events never expire. Events whose priority 
+		 * (usually the measurement timestamp) is older when they are dispatched are discarded.
+		 */
+		unsigned long long maxAge;
 		
-		/** number of events queued */
-		int nQueuedEvents;
+		/** number of events queued, including events not yet sorted into the queue */
+		boost::atomic< int > nQueuedEvents;
+
+		/** 
+		 * Ring of the events of this receiver that are sorted into the queue, in arrival order.
+		 * Used by the event queue to apply the overflow policy in constant time.
+		 */
+		boost::circular_buffer< EventRecord* > pendingEvents;
+
+		//@{
+		/** statistics, updated with relaxed atomic operations */
+		boost::atomic< int > nHighWaterMark;
+		boost::atomic< unsigned long long > nEnqueued;
+		boost::atomic< unsigned long long > nDispatched;
+		boost::atomic< unsigned long long > nDropped;
+		boost::atomic< unsigned long long > nExpired;
+		boost::atomic< unsigned long long > nDirect;
+		boost::atomic< unsigned long long > latencyHistogram[ latencyBuckets ];
+		//@}
 	};
 	
-	/** Constructor */
-	EventQueue();
+	/**
+	 * Constructor
+	 *
+	 * @param nThreads number of event dispatching threads. If 0, the number is taken from the
+	 *    environment variable UBITRACK_EVENTQUEUE_THREADS and defaults to 1.
+	 */
+	EventQueue( unsigned nThreads = 0 );
 
-	/** destructor, stops the event thread */
+	/** destructor, stops the event threads */
 	~EventQueue();
 
-	/** starts the event thread */
+	/** starts the event threads */
 	void start();
 
-	/** stops the event thread */
+	/** stops the event threads */
 	void stop();
 
 	/**
-	 * information stored in the queue internally and passed to queue()
+	 * Starts the event threads on behalf of one of several users of the queue, e.g. dataflow 
+	 * networks sharing it. The threads keep running until each user has called stopShared().
+	 */
+	void startShared();
+
+	/** ends a startShared(). Stops the event threads when no other user has started the queue. */
+	void stopShared();
+
+	/**
+	 * Changes the number of event dispatching threads.
+	 *
+	 * Events for different components are dispatched in parallel, but events for the same component
+	 * are serialized, and events on connected paths are only dispatched in parallel if they have the
+	 * same timestamp and rank. Must not be called from within an event handler.
+	 *
+	 * @param nThreads new number of threads
+	 */
+	void setNumberOfThreads( unsigned nThreads );
+
+	/** returns the number of event dispatching threads */
+	unsigned getNumberOfThreads() const;
+
+	/**
+	 * Sets the maximum number of events a dispatching thread takes from the queue at once.
+	 *
+	 * A batch only contains events with the same priority and rank as the first one, so the
+	 * order of dispatching is the same as with single events. With more than one thread, a
+	 * batch is also restricted to events for the same component. The default is taken from the 
+	 * environment variable UBITRACK_EVENTQUEUE_BATCH and is 16 if not set.
+	 *
+	 * @param nBatchSize maximum number of events per batch, at least 1
+	 */
+	void setBatchSize( unsigned nBatchSize );
+
+	/** returns the maximum number of events a dispatching thread takes from the queue at once */
+	unsigned getBatchSize() const;
+
+	/**
+	 * Enables grouped delivery. The events of a batch (see setBatchSize()) are then ordered so that
+	 * the events for the same component follow each other, and each such group is delivered with a 
+	 * single lock of the component mutex, enclosed in calls of Component::beginEventBatch() and 
+	 * Component::endEventBatch(). As a batch only contains events of the same priority, a component 
+	 * with several inputs gets all events of one timestamp in one group, as long as they fit into 
+	 * a batch. With several threads, a batch is collected for a single component, skipping events 
+	 * of the same timestamp for other components.
+	 *
+	 * Events of the same component keep their order. The default is taken from the environment
+	 * variable UBITRACK_EVENTQUEUE_GROUPED and is off if not set.
+	 */
+	void setGroupedDelivery( bool bGrouped );
+
+	/** returns true if grouped delivery is enabled */
+	bool getGroupedDelivery() const;
+
+	/** scheduling class of the dispatching threads */
+	enum SchedulingPolicy
+	{
+		/** do not change the scheduling of the threads */
+		scheduling_default,
+
+		/** real-time first-in, first-out scheduling (SCHED_FIFO) */
+		scheduling_fifo,
+
+		/** real-time round-robin scheduling (SCHED_RR) */
+		scheduling_rr
+	};
+
+	/**
+	 * Pins the dispatching threads to a set of CPUs. Only supported on Linux.
+	 *
+	 * The default is taken from the environment variable UBITRACK_EVENTQUEUE_CPUS, 
+	 * a list of CPUs and ranges like "0,2-3". The result can be checked with getThreadSettingsReport().
+	 *
+	 * @param cpus indices of the CPUs, empty to leave the affinity unchanged
+	 */
+	void setThreadAffinity( const std::vector< int >& cpus );
+
+	/**
+	 * Requests a real-time scheduling class for the dispatching threads. Only supported on Linux,
+	 * usually requires the CAP_SYS_NICE capability.
+	 *
+	 * The default is taken from the environment variable UBITRACK_EVENTQUEUE_SCHED, 
+	 * which is "fifo:<priority>" or "rr:<priority>". The result can be checked with getThreadSettingsReport().
+	 *
+	 * @param policy the scheduling class
+	 * @param priority the real-time priority, usually between 1 and 99
+	 */
+	void setThreadScheduling( SchedulingPolicy policy, int priority );
+
+	/** returns a description of the affinity and scheduling settings applied to the dispatching threads */
+	std::string getThreadSettingsReport() const;
+
+	/**
+	 * Description of an event, passed to queue().
+	 * Kept for compatibility, new code should use createEvent() instead.
 	 */
 	struct QueueData
 	{
@@ -113,27 +434,266 @@ public:
 		/** payload */
 		EventType event;
 
-		/** priority */
+		/** priority, usually the timestamp of the event */
 		unsigned long long priority;
 
+		/** event priority of the receiving component, see Component::getEventPriority() */
+		int rank;
+
 		/** simple constructor */
-		QueueData( ReceiverInfo* _pReceiverInfo, const EventType& rEvent, unsigned long long prio = 0L )
+		QueueData( ReceiverInfo* _pReceiverInfo, const EventType& rEvent, unsigned long long prio = 0L, int _rank = 0 )
 			: pReceiverInfo( _pReceiverInfo )
 			, event( rEvent )
 			, priority( prio )
+			, rank( _rank )
 			{}
 	};
 
 	/**
-	 * Add events to the queue
+	 * An event as stored in the queue.
+	 *
+	 * Records are taken from a pool owned by the event queue, so queueing and dispatching 
+	 * events does not allocate memory once the pool is large enough. The payload is any 
+	 * copyable function object. Payloads up to \c payloadSize bytes are stored inside the 
+	 * record.
+	 *
+	 * Events are ordered by the composite key (priority, rank, sequence):
+	 * first by timestamp, then by the topological rank of the receiving component
+	 * and finally by the order in which they were queued.
+	 */
+	class EventRecord
+		: private boost::noncopyable
+	{
+	public:
+		/** size of the payload storage inside the record */
+		enum { payloadSize = 8 * sizeof( void* ) };
+
+		/** constructor, creates a record without payload */
+		EventRecord()
+			: pReceiverInfo( 0 )
+			, priority( 0 )
+			, rank( 0 )
+			, sequence( 0 )
+			, queueTime( 0 )
+			, pNext( 0 )
+			, m_pOperations( 0 )
+		{}
+
+		~EventRecord()
+		{ clearPayload(); }
+
+		/** Pointer to ReceiverInfo struct. 0 if the event has been dropped. */
+		ReceiverInfo* pReceiverInfo;
+
+		/** priority, usually the timestamp of the event */
+		unsigned long long priority;
+
+		/** event priority of the receiving component, see Component::getEventPriority() */
+		int rank;
+
+		/** insertion counter, assigned by queue() to keep the order of events with equal priority and rank */
+		unsigned long long sequence;
+
+		/** time when the event was queued, for statistics */
+		unsigned long long queueTime;
+
+		/** next record in a chain passed to queue() */
+		EventRecord* pNext;
+
+		/** stores a copy of a function object as payload */
+		template< class Payload >
+		void setPayload( const Payload& payload )
+		{
+			clearPayload();
+			PayloadStorage< Payload >::type::create( m_storage.address(), payload );
+			m_pOperations = &PayloadStorage< Payload >::type::operations;
+		}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+		/** moves a function object into the record as payload */
+		template< class Payload >
+		void setPayload( Payload&& payload )
+		{
+			typedef typename boost::decay< Payload >::type PayloadType;
+			clearPayload();
+			PayloadStorage< PayloadType >::type::create( m_storage.address(), std::forward< Payload >( payload ) );
+			m_pOperations = &PayloadStorage< PayloadType >::type::operations;
+		}
+#endif
+
+		/** accesses the payload, which must be of type \c Payload */
+		template< class Payload >
+		Payload& getPayload()
+		{ return PayloadStorage< Payload >::type::get( m_storage.address() ); }
+
+		/** true if the record has a payload */
+		bool hasPayload() const
+		{ return m_pOperations != 0; }
+
+		/** calls the payload */
+		void invoke()
+		{ m_pOperations->invoke( m_storage.address() ); }
+
+		/** destroys the payload */
+		void clearPayload()
+		{
+			if ( m_pOperations )
+			{
+				m_pOperations->destroy( m_storage.address() );
+				m_pOperations = 0;
+			}
+		}
+
+		/** true if this event has to be dispatched after \c other */
+		bool isLaterThan( const EventRecord& other ) const
+		{
+			if ( priority != other.priority )
+				return priority > other.priority;
+			if ( rank != other.rank )
+				return rank > other.rank;
+			return sequence > other.sequence;
+		}
+
+	protected:
+		/** type of the payload storage */
+		typedef boost::aligned_storage< payloadSize >::type StorageType;
+
+		/** selects how a payload type is stored */
+		template< class Payload >
+		struct PayloadStorage
+		{
+			typedef EventPayloadStorage< Payload, ( sizeof( Payload ) <= std::size_t( payloadSize ) && 
+				boost::alignment_of< Payload >::value <= boost::alignment_of< StorageType >::value ) > type;
+		};
+
+		/** operations of the stored payload, 0 if there is none */
+		const EventPayloadOperations* m_pOperations;
+
+		/** payload storage */
+		StorageType m_storage;
+	};
+
+	/**
+	 * Creates an event record from the pool of the queue.
+	 * The record must be passed to queue() afterwards.
 	 *
-	 * @param events vector containing QueueData objects
+	 * @param pReceiverInfo the receiver of the event
+	 * @param payload function object to call when the event is dispatched
+	 * @param prio priority, usually the timestamp of the event
+	 * @param rank event priority of the receiving component
 	 */
-	void queue( std::vector< QueueData >& events );
+	template< class Payload >
+	EventRecord* createEvent( ReceiverInfo* pReceiverInfo, const Payload& payload, unsigned long long prio = 0L, int rank = 0 )
+	{
+		EventRecord* pRecord = allocateEvent();
+		pRecord->pReceiverInfo = pReceiverInfo;
+		pRecord->priority = prio;
+		pRecord->rank = rank;
+		pRecord->pNext = 0;
+		pRecord->setPayload( payload );
+		return pRecord;
+	}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/** creates an event record, moving the payload into the record */
+	template< class Payload >
+	EventRecord* createEvent( ReceiverInfo* pReceiverInfo, Payload&& payload, unsigned long long prio = 0L, int rank = 0 )
+	{
+		EventRecord* pRecord = allocateEvent();
+		pRecord->pReceiverInfo = pReceiverInfo;
+		pRecord->priority = prio;
+		pRecord->rank = rank;
+		pRecord->pNext = 0;
+		pRecord->setPayload( std::forward< Payload >( payload ) );
+		return pRecord;
+	}
+#endif
+
+	/**
+	 * Add events to the queue.
+	 *
+	 * The events are handed over to the dispatching threads through a lock-free buffer,
+	 * so producers do not contend for the queue mutex. They are sorted into the queue
+	 * in batches by the dispatching threads. The mutex is only locked to wake a dispatching
+	 * thread that sleeps, or while the queue is stopped.
+	 *
+	 * @param pEvents chain of records created by createEvent(), linked by \c pNext in the 
+	 *    order they were sent. The queue takes ownership of the records.
+	 */
+	void queue( EventRecord* pEvents );
+
+	/**
+	 * Add events to the queue.
+	 *
+	 * @param events vector containing QueueData objects, which are copied into the queue. 
+	 *    Events without payload are ignored.
+	 */
+	void queue( const std::vector< QueueData >& events );
+
+	/**
+	 * Tries to deliver an event by calling the receiver directly instead of queueing it.
+	 * This avoids the queue for short chains of components, where it only serves to prevent deep recursion.
+	 *
+	 * The event is delivered directly only if
+	 * - the queue is running,
+	 * - no events are queued for the receiver's component, so it cannot overtake them,
+	 * - the nesting of direct calls in the calling thread is below getMaxDirectDepth(),
+	 * - the receiver's mutex can be locked without waiting, and
+	 * - the receiver is not already handling an event or a pull further up the stack of the calling thread.
+	 *
+	 * Events of each receiver are still delivered in the order they were sent. Events delivered directly
+	 * may however overtake events with an earlier timestamp that are queued for other receivers, so the 
+	 * global (timestamp, rank) order of the queue does not hold for them.
+	 *
+	 * @param rReceiver the receiver of the event
+	 * @param payload function object that delivers the event
+	 * @return true if the event was delivered, false if the caller must queue it
+	 */
+	template< class Payload >
+	bool dispatchDirect( ReceiverInfo& rReceiver, Payload& payload )
+	{
+		unsigned long long startTime;
+		if ( !enterDirectDispatch( rReceiver, startTime ) )
+			return false;
+
+		try
+		{
+			payload();
+		}
+		catch ( ... )
+		{
+			reportException( &rReceiver );
+		}
+
+		leaveDirectDispatch( rReceiver, startTime );
+		return true;
+	}
+
+	/** 
+	 * Sets the maximum nesting depth of direct dispatch, see dispatchDirect(). 0 disables direct dispatch.
+	 * The default is 4.
+	 */
+	void setMaxDirectDepth( unsigned nDepth );
+
+	/** returns the maximum nesting depth of direct dispatch */
+	unsigned getMaxDirectDepth() const;
+
+	/** type of functions that return the current time in nanoseconds, see setAgeClock() */
+	typedef boost::function< unsigned long long () > ClockType;
+
+	/**
+	 * Sets the clock the age of events is measured with, see ReceiverInfo::maxAge. By default, this
+	 * is Measurement::now(). Replays of recorded events use the recorded time, see EventReplayer.
+	 * An empty function restores the default. The function is called with the queue locked.
+	 */
+	void setAgeClock( const ClockType& clock );
 
 	/**
 	 * Removes all events that belong to a particular component
 	 *
+	 * Only the events queued for the ports of the component are visited. Their payloads are
+	 * released immediately, the queue entries are discarded when they reach the front.
+	 *
 	 * @param pComponent pointer to component whose events to remove
 	 */
 	void removeComponent( const Component* pComponent );
@@ -144,6 +704,12 @@ public:
 	/** remove all queued events */
 	void clear();
 
+	/** returns a snapshot of the statistics of the queue. May be called from any thread. */
+	Statistics getStatistics() const;
+
+	/** restarts the statistics of the queue. The statistics of the receivers are not changed. */
+	void resetStatistics();
+
 	/** get the main eventqueue object */
 	static EventQueue& singleton();
 
@@ -153,20 +719,227 @@ protected:
 	/** queue thread function */
 	void threadFunction();
 
+	/** takes a record from the pool, allocating more records if necessary */
+	EventRecord* allocateEvent();
+
+	/** returns a record to the pool */
+	void releaseEvent( EventRecord* pRecord );
+
+	/** 
+	 * Removes the first event from the queue and its receiver's ring. Caller must hold m_Mutex.
+	 * @return the event, to be released by the caller
+	 */
+	EventRecord* popFront();
+
+	/** removes an event from its receiver's ring and updates the counters. Caller must hold m_Mutex. */
+	void detachEvent( EventRecord* pRecord );
+
+	/** 
+	 * Drops an event that is still in the queue. The payload is released immediately, the entry 
+	 * stays in the queue and is discarded when it reaches the front. Caller must hold m_Mutex.
+	 */
+	void cancelEvent( EventRecord* pRecord );
+
+	/** blocks the calling thread until the receiver has space for another event */
+	void waitForSpace( ReceiverInfo* pReceiverInfo );
+
+	/** logs dropped events, limiting the number of messages */
+	void reportDrop( ReceiverInfo* pReceiverInfo );
+
+	/** 
+	 * Checks if the first event in the queue is older than the maximum age of its receiver
+	 * and discards it in that case. Caller must hold m_Mutex.
+	 *
+	 * @param now current time, 0 if not yet known. Set by the method if needed.
+	 * @return true if the event was discarded
+	 */
+	bool discardExpired( unsigned long long& now );
+
+	/** 
+	 * Moves all events from the lock-free ingress buffer into the queue and applies the overflow 
+	 * policies of the receivers. Caller must hold m_Mutex.
+	 */
+	void drainIngress();
+
+	/**
+	 * Removes the next event that may be dispatched now from the queue.
+	 * Caller must hold m_Mutex.
+	 *
+	 * @return the event, to be released by the caller, or 0 if none can be dispatched
+	 */
+	EventRecord* takeEvent();
+
+	/**
+	 * Removes a batch of events that may be dispatched now from the queue, see setBatchSize().
+	 * Caller must hold m_Mutex.
+	 *
+	 * @param batch receives the events, to be released by the caller. Empty if none can be dispatched.
+	 */
+	void takeBatch( std::vector< EventRecord* >& batch );
+
+	/** 
+	 * Returns true if the queue holds an event that another thread could dispatch in parallel to the 
+	 * events in flight. Caller must hold m_Mutex.
+	 */
+	bool hasDispatchableEvent() const;
+
+	/** checks if an event may be dispatched in parallel to the events in flight. Caller must hold m_Mutex. */
+	bool mayDispatch( const EventRecord& event, int group, const std::vector< int >& blockedGroups ) const;
+
+	/** calls an event, locking the receiver's mutex */
+	void invokeEvent( EventRecord& event );
+
+	/** 
+	 * Calls a group of events for the same component, locking the component mutex once, 
+	 * see setGroupedDelivery().
+	 */
+	void invokeGroup( EventRecord** pFirst, EventRecord** pLast );
+
+	/** 
+	 * Orders a batch so that the events of each component follow each other, keeping the first event
+	 * in front and the order of the events of each component.
+	 */
+	static void groupBatch( std::vector< EventRecord* >& batch );
+
+	/** logs the exception currently being handled, which was thrown by an event handler. Must be called from a catch block. */
+	void reportException( ReceiverInfo* pReceiverInfo );
+
+	/** updates the statistics after an event has been dispatched */
+	void recordDispatch( ReceiverInfo* pReceiverInfo, unsigned long long queueTime, unsigned long long startTime );
+
+	/** 
+	 * Checks the conditions of dispatchDirect() and locks the receiver.
+	 * @param startTime set to the current time if direct dispatch is possible
+	 * @return true if the event may be delivered directly, leaveDirectDispatch() must be called afterwards
+	 */
+	bool enterDirectDispatch( ReceiverInfo& rReceiver, unsigned long long& startTime );
+
+	/** unlocks the receiver after direct dispatch and updates the statistics */
+	void leaveDirectDispatch( ReceiverInfo& rReceiver, unsigned long long startTime );
+
+	/** creates the event dispatching threads */
+	void startThreads( unsigned nThreads );
+
+	/** ends all event dispatching threads and waits for them */
+	void endThreads();
+
+	/** applies the affinity and scheduling settings to all dispatching threads and updates the report */
+	void applyThreadSettings();
+
 	/** mutex for thread synchronization */
 	boost::mutex m_Mutex;
 
 	/** condition variable for thread synchronization */
 	boost::condition m_NewEventCondition;
 
+	/** condition variable signalled when events of a receiver with overflow_block_producer policy are removed */
+	boost::condition m_SpaceCondition;
+
 	/** type of queue data */
-	typedef std::list< QueueData > QueueType;
+	typedef std::vector< EventRecord* > QueueType;
 
-	/** the queue */
+	/** the queue, organized as a binary heap with the earliest event in front */
 	QueueType m_Queue;
 
-	/** the event dispatching thread */
-	boost::shared_ptr< boost::thread > m_pThread;
+	/** sequence number assigned to the next queued event */
+	unsigned long long m_nextSequence;
+
+	/** 
+	 * Lock-free ingress buffer, a stack of records linked by \c pNext with the newest record on top.
+	 * Producers push, the dispatching threads take the whole stack while holding m_Mutex.
+	 */
+	boost::atomic< EventRecord* > m_pIngress;
+
+	/** records that are not in use */
+	boost::lockfree::stack< EventRecord* > m_freeEvents;
+
+	/** mutex for allocating new slabs of records */
+	boost::mutex m_slabMutex;
+
+	/** all records owned by the queue, allocated in slabs */
+	std::vector< boost::shared_array< EventRecord > > m_slabs;
+
+	/** events that could not be dispatched in parallel yet, only used inside takeEvent() and takeBatch() */
+	QueueType m_deferred;
+
+	/** information about an event that is currently being dispatched */
+	struct InFlightEvent
+	{
+		/** event group of the receiving component */
+		int group;
+
+		/** priority of the event */
+		unsigned long long priority;
+
+		/** rank of the event */
+		int rank;
+
+		/** sequence number, identifies the event */
+		unsigned long long sequence;
+
+		/** mutex of the receiver */
+		ReceiverInfo::MutexType* pMutex;
+	};
+
+	/** type of list of events in flight */
+	typedef std::vector< InFlightEvent > InFlightList;
+
+	/** events currently dispatched by the threads, only maintained with more than one thread */
+	InFlightList m_inFlight;
+
+	/** time when the statistics were started */
+	boost::atomic< unsigned long long > m_statisticsStartTime;
+
+	/** number of dispatched events */
+	boost::atomic< unsigned long long > m_nDispatched;
+
+	/** time spent in event handlers */
+	boost::atomic< unsigned long long > m_dispatchTime;
+
+	/** number of event dispatching threads */
+	unsigned m_nThreads;
+
+	/** maximum number of events taken from the queue at once */
+	unsigned m_nBatchSize;
+
+	/** deliver the events of a batch grouped by component */
+	bool m_bGroupedDelivery;
+
+	/** CPUs the dispatching threads are pinned to, empty if not pinned. The thread settings are protected by m_Mutex. */
+	std::vector< int > m_cpuAffinity;
+
+	/** scheduling class of the dispatching threads */
+	SchedulingPolicy m_schedulingPolicy;
+
+	/** real-time priority of the dispatching threads */
+	int m_schedulingPriority;
+
+	/** what applyThreadSettings() did, protected by m_Mutex */
+	std::string m_threadSettingsReport;
+
+	/** maximum nesting depth of direct dispatch */
+	unsigned m_nMaxDirectDepth;
+
+	/** the clock for event ages, empty for Measurement::now() */
+	ClockType m_ageClock;
+
+	/** protects m_nSharedStarts, held while the queue is started or stopped by startShared() and stopShared() */
+	boost::mutex m_sharedStartMutex;
+
+	/** number of startShared() calls without stopShared() */
+	unsigned m_nSharedStarts;
+
+	/** true while the queue is running, for direct dispatch which does not lock m_Mutex */
+	boost::atomic< bool > m_bRunning;
+
+	/** 
+	 * Number of dispatching threads waiting for m_NewEventCondition. Only changed while holding m_Mutex,
+	 * but read by producers without it, see queue().
+	 */
+	boost::atomic< unsigned > m_nWaitingThreads;
+
+	/** the event dispatching threads */
+	std::vector< boost::shared_ptr< boost::thread > > m_threads;
 
 	/** current state of the event thread */
 	enum { state_running, state_stopping, state_stopped, state_end } m_State;
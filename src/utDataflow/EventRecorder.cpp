@@ -0,0 +1,179 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the event recorder
+ */
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <boost/filesystem/operations.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include "EventRecorder.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.EventRecorder" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+
+const boost::uint32_t EventRecorder::channelDefinition;
+
+/** \internal records are aligned to 8 bytes */
+static std::size_t paddedSize( std::size_t nSize )
+{ return ( nSize + 7 ) & ~std::size_t( 7 ); }
+
+
+EventRecorder::EventRecorder( const std::string& sFileName, std::size_t nInitialSize )
+	: m_sFileName( sFileName )
+	, m_nBytes( sizeof( FileHeader ) )
+	, m_nEvents( 0 )
+{
+	// create an empty file
+	{
+		std::ofstream file( sFileName.c_str(), std::ios::binary | std::ios::trunc );
+		if ( !file )
+			UBITRACK_THROW( "Cannot create event recording " + sFileName );
+	}
+
+	mapFile( std::max( nInitialSize, sizeof( FileHeader ) ) );
+
+	FileHeader* pHeader = static_cast< FileHeader* >( m_pRegion->get_address() );
+	std::memcpy( pHeader->magic, "UTEVREC1", sizeof( pHeader->magic ) );
+	pHeader->nBytes = m_nBytes;
+
+	LOG4CPP_INFO( logger, "Recording events to " << sFileName );
+}
+
+
+EventRecorder::~EventRecorder()
+{
+	try
+	{
+		close();
+	}
+	catch ( const std::exception& e )
+	{
+		LOG4CPP_ERROR( logger, "Cannot close event recording " << m_sFileName << ": " << e.what() );
+	}
+}
+
+
+void EventRecorder::close()
+{
+	// stop recording
+	for ( std::vector< boost::function< void () > >::iterator it = m_detachFunctions.begin(); it != m_detachFunctions.end(); it++ )
+		(*it)();
+	m_detachFunctions.clear();
+
+	boost::mutex::scoped_lock l( m_mutex );
+	if ( !m_pRegion )
+		return;
+
+	m_pRegion->flush();
+	m_pRegion.reset();
+	m_pFile.reset();
+
+	boost::filesystem::resize_file( m_sFileName, m_nBytes );
+	LOG4CPP_INFO( logger, "Recorded " << m_nEvents << " events, " << m_nBytes << " bytes to " << m_sFileName );
+}
+
+
+unsigned long long EventRecorder::getEventCount() const
+{
+	boost::mutex::scoped_lock l( m_mutex );
+	return m_nEvents;
+}
+
+
+unsigned long long EventRecorder::getByteCount() const
+{
+	boost::mutex::scoped_lock l( m_mutex );
+	return m_nBytes;
+}
+
+
+boost::uint32_t EventRecorder::addChannel( const std::string& sChannel )
+{
+	boost::uint32_t channel;
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		std::map< std::string, boost::uint32_t >::iterator it = m_channels.find( sChannel );
+		if ( it != m_channels.end() )
+			return it->second;
+
+		channel = static_cast< boost::uint32_t >( m_channels.size() );
+		m_channels[ sChannel ] = channel;
+	}
+
+	LOG4CPP_DEBUG( logger, "Recording channel " << channel << ": " << sChannel );
+	writeRecord( channelDefinition, channel, 0, sChannel.data(), sChannel.size() );
+	return channel;
+}
+
+
+void EventRecorder::writeRecord( boost::uint32_t channel, unsigned long long priority, unsigned long long sendTime,
+	const char* pData, std::size_t nSize )
+{
+	boost::mutex::scoped_lock l( m_mutex );
+	if ( !m_pRegion )
+		return;
+
+	// grow the file
+	const std::size_t nRecordSize = sizeof( RecordHeader ) + paddedSize( nSize );
+	if ( m_nBytes + nRecordSize > m_pRegion->get_size() )
+		mapFile( std::max( 2 * m_pRegion->get_size(), m_nBytes + nRecordSize ) );
+
+	char* pBase = static_cast< char* >( m_pRegion->get_address() );
+	RecordHeader* pRecord = reinterpret_cast< RecordHeader* >( pBase + m_nBytes );
+	pRecord->channel = channel;
+	pRecord->nSize = static_cast< boost::uint32_t >( nSize );
+	pRecord->priority = priority;
+	pRecord->sendTime = sendTime;
+	std::memcpy( pRecord + 1, pData, nSize );
+
+	m_nBytes += nRecordSize;
+	reinterpret_cast< FileHeader* >( pBase )->nBytes = m_nBytes;
+	if ( channel != channelDefinition )
+		m_nEvents++;
+}
+
+
+void EventRecorder::mapFile( std::size_t nSize )
+{
+	LOG4CPP_DEBUG( logger, "Mapping " << nSize << " bytes of " << m_sFileName );
+
+	m_pRegion.reset();
+	m_pFile.reset();
+
+	boost::filesystem::resize_file( m_sFileName, nSize );
+	m_pFile.reset( new boost::interprocess::file_mapping( m_sFileName.c_str(), boost::interprocess::read_write ) );
+	m_pRegion.reset( new boost::interprocess::mapped_region( *m_pFile, boost::interprocess::read_write ) );
+}
+
+
+} } // namespace Ubitrack::Dataflow
@@ -0,0 +1,199 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Recording of the events sent by push suppliers into a memory-mapped file
+ */
+
+#ifndef __Ubitrack_Dataflow_EventRecorder_INCLUDED__
+#define __Ubitrack_Dataflow_EventRecorder_INCLUDED__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <utDataflow.h>
+#include <utMeasurement/Timestamp.h>
+#include "PushSupplier.h"
+#include "EventTypeTraits.h"
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * Records the events sent by push suppliers, e.g. the outputs of source components, into a
+ * memory-mapped file, so they can be replayed without the hardware by an EventReplayer.
+ *
+ * The events of each port are stored in a channel, together with their priority (usually the
+ * measurement timestamp) and the time they were sent. Event types are serialized with
+ * boost::serialization binary archives, so they need a \c serialize() method.
+ *
+ * The file consists of a FileHeader and a sequence of records, each a RecordHeader followed by
+ * the data, padded to 8 bytes. The channels are defined by records with the channel id
+ * \c channelDefinition, whose data is the channel name and whose priority is the channel id.
+ *
+ * Events may be recorded from several threads, and recording can be closed while the network
+ * is running. The network should however be stopped before the recorder is destroyed, as sends
+ * that are already running may still call it.
+ */
+class UTDATAFLOW_EXPORT EventRecorder
+	: private boost::noncopyable
+{
+public:
+	/** header at the start of the file */
+	struct FileHeader
+	{
+		/** "UTEVREC1" */
+		char magic[ 8 ];
+
+		/** number of bytes used in the file, including the header */
+		boost::uint64_t nBytes;
+	};
+
+	/** header of each record */
+	struct RecordHeader
+	{
+		/** channel of the record, or channelDefinition */
+		boost::uint32_t channel;
+
+		/** size of the data, without padding */
+		boost::uint32_t nSize;
+
+		/** priority of the event, usually the measurement timestamp */
+		boost::uint64_t priority;
+
+		/** time when the event was sent */
+		boost::uint64_t sendTime;
+	};
+
+	/** channel id of records that define channels */
+	static const boost::uint32_t channelDefinition = 0xffffffff;
+
+	/**
+	 * Creates the file, replacing an existing one.
+	 *
+	 * @param sFileName name of the file
+	 * @param nInitialSize initial size of the file. The file grows as needed, and is truncated to the used size when closed.
+	 */
+	EventRecorder( const std::string& sFileName, std::size_t nInitialSize = 1 << 24 );
+
+	/** detaches from all ports and closes the file */
+	~EventRecorder();
+
+	/**
+	 * Records all events sent by a port.
+	 *
+	 * @param rPort the port
+	 * @param sChannel name of the channel, used to find the port when replaying
+	 */
+	template< class EventType >
+	void record( PushSupplierCore< EventType >& rPort, const std::string& sChannel )
+	{
+		boost::uint32_t channel = addChannel( sChannel );
+		rPort.setSendHook( boost::bind( &EventRecorder::recordEvent< EventType >, this, channel, _1 ) );
+		m_detachFunctions.push_back( boost::bind( &PushSupplierCore< EventType >::setSendHook, &rPort,
+			typename PushSupplierCore< EventType >::SendHookType() ) );
+	}
+
+	/** records all events sent by a port, using the full name of the port as channel name */
+	template< class EventType >
+	void record( PushSupplier< EventType >& rPort )
+	{ record( rPort, rPort.fullName() ); }
+
+	/** stops recording, detaches from all ports and truncates the file to the used size */
+	void close();
+
+	/** returns the number of recorded events */
+	unsigned long long getEventCount() const;
+
+	/** returns the number of bytes written to the file, including headers */
+	unsigned long long getByteCount() const;
+
+protected:
+	/** serializes an event and writes it to the file */
+	template< class EventType >
+	void recordEvent( boost::uint32_t channel, const EventType& rEvent )
+	{
+		const unsigned long long sendTime( Measurement::now() );
+
+		std::ostringstream stream;
+		{
+			boost::archive::binary_oarchive archive( stream, boost::archive::no_header );
+			archive << rEvent;
+		}
+
+		const std::string& data( stream.str() );
+		writeRecord( channel, EventTypeTraits< EventType >().getPriority( rEvent ), sendTime, data.data(), data.size() );
+	}
+
+	/** defines a channel and returns its id */
+	boost::uint32_t addChannel( const std::string& sChannel );
+
+	/** appends a record to the file, growing it if necessary */
+	void writeRecord( boost::uint32_t channel, unsigned long long priority, unsigned long long sendTime,
+		const char* pData, std::size_t nSize );
+
+	/** maps the file into memory */
+	void mapFile( std::size_t nSize );
+
+	/** name of the file */
+	std::string m_sFileName;
+
+	/** protects the following members */
+	mutable boost::mutex m_mutex;
+
+	/** the file */
+	boost::scoped_ptr< boost::interprocess::file_mapping > m_pFile;
+
+	/** the mapped file */
+	boost::scoped_ptr< boost::interprocess::mapped_region > m_pRegion;
+
+	/** number of used bytes */
+	std::size_t m_nBytes;
+
+	/** number of recorded events */
+	unsigned long long m_nEvents;
+
+	/** ids of the channels */
+	std::map< std::string, boost::uint32_t > m_channels;
+
+	/** functions removing the hooks from the recorded ports */
+	std::vector< boost::function< void () > > m_detachFunctions;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
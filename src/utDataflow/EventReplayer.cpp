@@ -0,0 +1,208 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the event replayer
+ */
+
+#include <cstring>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include <utMeasurement/Timestamp.h>
+#include "EventReplayer.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.EventReplayer" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/** \internal records are aligned to 8 bytes */
+static std::size_t paddedSize( std::size_t nSize )
+{ return ( nSize + 7 ) & ~std::size_t( 7 ); }
+
+/** \internal returns true if the header and data of the record at nPos are within the first nBytes */
+static bool isComplete( const char* pBase, std::size_t nPos, std::size_t nBytes )
+{
+	if ( nPos + sizeof( EventRecorder::RecordHeader ) > nBytes )
+		return false;
+	const EventRecorder::RecordHeader* pRecord = reinterpret_cast< const EventRecorder::RecordHeader* >( pBase + nPos );
+	return pRecord->nSize <= nBytes - nPos - sizeof( EventRecorder::RecordHeader );
+}
+
+
+EventReplayer::EventReplayer( const std::string& sFileName )
+	: m_nBytes( 0 )
+	, m_mode( replay_fast )
+	, m_bStop( false )
+	, m_virtualTime( 0 )
+{
+	try
+	{
+		m_pFile.reset( new boost::interprocess::file_mapping( sFileName.c_str(), boost::interprocess::read_only ) );
+		m_pRegion.reset( new boost::interprocess::mapped_region( *m_pFile, boost::interprocess::read_only ) );
+	}
+	catch ( const boost::interprocess::interprocess_exception& e )
+	{
+		UBITRACK_THROW( "Cannot open event recording " + sFileName + ": " + e.what() );
+	}
+
+	const char* pBase = static_cast< const char* >( m_pRegion->get_address() );
+	const EventRecorder::FileHeader* pHeader = reinterpret_cast< const EventRecorder::FileHeader* >( pBase );
+	if ( m_pRegion->get_size() < sizeof( EventRecorder::FileHeader ) || std::memcmp( pHeader->magic, "UTEVREC1", sizeof( pHeader->magic ) ) )
+		UBITRACK_THROW( "Not an event recording: " + sFileName );
+	m_nBytes = static_cast< std::size_t >( std::min< boost::uint64_t >( pHeader->nBytes, m_pRegion->get_size() ) );
+
+	// read the channel definitions
+	for ( std::size_t nPos = sizeof( EventRecorder::FileHeader ); nPos + sizeof( EventRecorder::RecordHeader ) <= m_nBytes; )
+	{
+		if ( !isComplete( pBase, nPos, m_nBytes ) )
+		{
+			LOG4CPP_ERROR( logger, "Event recording " << sFileName << " is truncated or corrupt at byte " << nPos 
+				<< ", replaying only the events before" );
+			m_nBytes = nPos;
+			break;
+		}
+
+		const EventRecorder::RecordHeader* pRecord = reinterpret_cast< const EventRecorder::RecordHeader* >( pBase + nPos );
+		if ( pRecord->channel == EventRecorder::channelDefinition )
+			m_channels[ std::string( reinterpret_cast< const char* >( pRecord + 1 ), pRecord->nSize ) ] =
+				static_cast< boost::uint32_t >( pRecord->priority );
+		nPos += sizeof( EventRecorder::RecordHeader ) + paddedSize( pRecord->nSize );
+	}
+
+	LOG4CPP_INFO( logger, "Opened event recording " << sFileName << " with " << m_channels.size() << " channels" );
+}
+
+
+EventReplayer::~EventReplayer()
+{
+	for ( std::set< EventQueue* >::iterator it = m_queues.begin(); it != m_queues.end(); it++ )
+		(*it)->setAgeClock( EventQueue::ClockType() );
+}
+
+
+std::vector< std::string > EventReplayer::getChannels() const
+{
+	std::vector< std::string > result;
+	for ( std::map< std::string, boost::uint32_t >::const_iterator it = m_channels.begin(); it != m_channels.end(); it++ )
+		result.push_back( it->first );
+	return result;
+}
+
+
+boost::uint32_t EventReplayer::findChannel( const std::string& sChannel ) const
+{
+	std::map< std::string, boost::uint32_t >::const_iterator it = m_channels.find( sChannel );
+	if ( it == m_channels.end() )
+		UBITRACK_THROW( "Channel " + sChannel + " not found in event recording" );
+	return it->second;
+}
+
+
+void EventReplayer::stop()
+{
+	m_bStop.store( true, boost::memory_order_relaxed );
+}
+
+
+EventReplayer::Statistics EventReplayer::run( ReplayMode mode, double speed )
+{
+	LOG4CPP_INFO( logger, "Replaying events " << ( mode == replay_fast ? "as fast as possible" : "in real time" ) );
+
+	m_mode = mode;
+	m_bStop.store( false, boost::memory_order_relaxed );
+
+	Statistics stats;
+	std::memset( &stats, 0, sizeof( stats ) );
+
+	// events expire according to the recorded timing
+	for ( std::set< EventQueue* >::iterator it = m_queues.begin(); it != m_queues.end(); it++ )
+		(*it)->setAgeClock( boost::bind( &EventReplayer::getVirtualTime, this ) );
+
+	const char* pBase = static_cast< const char* >( m_pRegion->get_address() );
+	const unsigned long long startTime( Measurement::now() );
+	unsigned long long firstSendTime = 0;
+
+	for ( std::size_t nPos = sizeof( EventRecorder::FileHeader );
+		nPos + sizeof( EventRecorder::RecordHeader ) <= m_nBytes && !m_bStop.load( boost::memory_order_relaxed ); )
+	{
+		// m_nBytes ends before the first bad record, this only guards against changes of the file
+		if ( !isComplete( pBase, nPos, m_nBytes ) )
+		{
+			LOG4CPP_ERROR( logger, "Event recording is corrupt at byte " << nPos << ", stopping the replay" );
+			break;
+		}
+
+		const EventRecorder::RecordHeader* pRecord = reinterpret_cast< const EventRecorder::RecordHeader* >( pBase + nPos );
+		nPos += sizeof( EventRecorder::RecordHeader ) + paddedSize( pRecord->nSize );
+		if ( pRecord->channel == EventRecorder::channelDefinition )
+			continue;
+
+		std::map< boost::uint32_t, SenderType >::iterator itSender = m_senders.find( pRecord->channel );
+		if ( itSender == m_senders.end() )
+		{
+			stats.nSkipped++;
+			continue;
+		}
+
+		// advance the virtual clock
+		if ( !firstSendTime )
+			firstSendTime = pRecord->sendTime;
+		m_virtualTime.store( pRecord->sendTime, boost::memory_order_relaxed );
+		stats.virtualTime = pRecord->sendTime - firstSendTime;
+
+		if ( mode == replay_realtime )
+		{
+			// wait until the event is due
+			const unsigned long long dueTime = startTime + static_cast< unsigned long long >( stats.virtualTime / speed );
+			const unsigned long long now( Measurement::now() );
+			if ( dueTime > now )
+				boost::this_thread::sleep( boost::posix_time::microseconds( ( dueTime - now ) / 1000 ) );
+		}
+
+		try
+		{
+			itSender->second( reinterpret_cast< const char* >( pRecord + 1 ), pRecord->nSize );
+		}
+		catch ( const std::exception& e )
+		{
+			LOG4CPP_ERROR( logger, "Cannot replay event of channel " << pRecord->channel << ": " << e.what() );
+			continue;
+		}
+
+		stats.nEvents++;
+		stats.nBytes += pRecord->nSize;
+	}
+
+	stats.wallTime = Measurement::now() - startTime;
+	LOG4CPP_INFO( logger, "Replayed " << stats.nEvents << " events in " << stats.wallTime / 1000000 << "ms, "
+		<< stats.eventRate() << " events/s" );
+	return stats;
+}
+
+
+} } // namespace Ubitrack::Dataflow
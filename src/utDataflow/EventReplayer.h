@@ -0,0 +1,214 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Replay of events recorded by an EventRecorder
+ */
+
+#ifndef __Ubitrack_Dataflow_EventReplayer_INCLUDED__
+#define __Ubitrack_Dataflow_EventReplayer_INCLUDED__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <utDataflow.h>
+#include "PushSupplier.h"
+#include "EventRecorder.h"
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * Sends events recorded by an EventRecorder through push supplier ports again, e.g. the outputs
+ * of source components whose hardware is not available. Events keep their recorded contents and
+ * timestamps, so runs are reproducible.
+ *
+ * The replay is driven by a virtual clock, which is set to the recorded send time of each event
+ * before it is sent. In real-time mode, the replay waits until the virtual time is reached in
+ * real time, optionally faster or slower. In fast mode, events are sent as fast as the network
+ * consumes them: the replay waits while all consumers of a port are saturated, so no events are
+ * dropped by bounded queues.
+ *
+ * While replaying, the event queues of the replayed ports measure the age of events with the 
+ * virtual clock, so a maximum event age configured on the receivers applies to the recorded 
+ * timing, see EventQueue::setAgeClock(). The queues keep the virtual clock until the replayer is 
+ * destroyed, so events still queued when run() returns do not expire.
+ */
+class UTDATAFLOW_EXPORT EventReplayer
+	: private boost::noncopyable
+{
+public:
+	/** how to pace the replay */
+	enum ReplayMode
+	{
+		/** reproduce the recorded timing */
+		replay_realtime,
+
+		/** send events as fast as they are consumed */
+		replay_fast
+	};
+
+	/** results of a replay */
+	struct Statistics
+	{
+		/** number of replayed events */
+		unsigned long long nEvents;
+
+		/** number of events of channels without a port */
+		unsigned long long nSkipped;
+
+		/** number of bytes of replayed event data */
+		unsigned long long nBytes;
+
+		/** duration of the replay in nanoseconds */
+		unsigned long long wallTime;
+
+		/** recorded duration of the replayed events in nanoseconds */
+		unsigned long long virtualTime;
+
+		/** replayed events per second */
+		double eventRate() const
+		{ return wallTime ? nEvents * 1e9 / wallTime : 0.0; }
+	};
+
+	/**
+	 * Opens a recording.
+	 * @param sFileName name of a file written by EventRecorder
+	 */
+	EventReplayer( const std::string& sFileName );
+
+	~EventReplayer();
+
+	/** returns the names of all channels in the recording */
+	std::vector< std::string > getChannels() const;
+
+	/**
+	 * Replays the events of a channel through a port.
+	 *
+	 * @param sChannel name of the channel, throws if it is not in the recording
+	 * @param rPort the port, must have the event type that was recorded
+	 * @param rQueue the event queue of the receivers, which gets the virtual clock
+	 */
+	template< class EventType >
+	void replay( const std::string& sChannel, PushSupplierCore< EventType >& rPort, EventQueue& rQueue )
+	{
+		m_senders[ findChannel( sChannel ) ] = boost::bind( &EventReplayer::sendEvent< EventType >, this, boost::ref( rPort ), _1, _2 );
+		m_queues.insert( &rQueue );
+	}
+
+	/** replays the events of a channel through a push supplier port */
+	template< class EventType >
+	void replay( const std::string& sChannel, PushSupplier< EventType >& rPort )
+	{ replay( sChannel, rPort, rPort.getEventQueue() ); }
+
+	/** replays the events of the channel named like the full name of the port */
+	template< class EventType >
+	void replay( PushSupplier< EventType >& rPort )
+	{ replay( rPort.fullName(), rPort ); }
+
+	/**
+	 * Replays the recording in the calling thread. Returns when all events have been sent or stop() was called.
+	 *
+	 * @param mode how to pace the replay
+	 * @param speed speed factor for real-time mode, 2.0 replays twice as fast
+	 */
+	Statistics run( ReplayMode mode = replay_fast, double speed = 1.0 );
+
+	/** makes run() return as soon as possible. May be called from any thread. */
+	void stop();
+
+	/** returns the virtual time: the recorded send time of the event being replayed */
+	unsigned long long getVirtualTime() const
+	{ return m_virtualTime.load( boost::memory_order_relaxed ); }
+
+protected:
+	/** deserializes an event and sends it through a port */
+	template< class EventType >
+	void sendEvent( PushSupplierCore< EventType >& rPort, const char* pData, std::size_t nSize )
+	{
+		EventType event;
+		{
+			std::istringstream stream( std::string( pData, nSize ) );
+			boost::archive::binary_iarchive archive( stream, boost::archive::no_header );
+			archive >> event;
+		}
+
+		// do not lose events in bounded queues
+		while ( m_mode == replay_fast && rPort.isSaturated() && !m_bStop.load( boost::memory_order_relaxed ) )
+			boost::this_thread::yield();
+
+		rPort.send( event );
+	}
+
+	/** returns the id of a channel */
+	boost::uint32_t findChannel( const std::string& sChannel ) const;
+
+	/** type of functions that deserialize and send an event */
+	typedef boost::function< void ( const char*, std::size_t ) > SenderType;
+
+	/** the file */
+	boost::scoped_ptr< boost::interprocess::file_mapping > m_pFile;
+
+	/** the mapped file */
+	boost::scoped_ptr< boost::interprocess::mapped_region > m_pRegion;
+
+	/** number of used bytes in the file */
+	std::size_t m_nBytes;
+
+	/** ids of the channels */
+	std::map< std::string, boost::uint32_t > m_channels;
+
+	/** senders of the channels */
+	std::map< boost::uint32_t, SenderType > m_senders;
+
+	/** event queues of the replayed ports */
+	std::set< EventQueue* > m_queues;
+
+	/** mode of the current replay */
+	ReplayMode m_mode;
+
+	/** set by stop() */
+	boost::atomic< bool > m_bStop;
+
+	/** the virtual clock */
+	boost::atomic< unsigned long long > m_virtualTime;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the event tracer
+ */
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include "EventTracer.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.EventTracer" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+boost::atomic< bool > EventTracer::s_bEnabled( false );
+
+/** \internal ring buffer of the records of one thread, only written by that thread */
+struct TraceRing
+{
+	TraceRing( std::size_t nSize, unsigned _threadId )
+		: records( nSize )
+		, nWritten( 0 )
+		, threadId( _threadId )
+	{}
+
+	/** the records */
+	std::vector< EventTracer::Record > records;
+
+	/** number of records written since the last clear */
+	boost::atomic< unsigned long long > nWritten;
+
+	/** number of the thread in the trace */
+	unsigned threadId;
+};
+
+/** \internal the tracer owns the rings, so the thread-specific pointer must not delete them */
+static void noCleanup( TraceRing* )
+{}
+
+/** \internal ring of the calling thread */
+static boost::thread_specific_ptr< TraceRing > g_pTraceRing( &noCleanup );
+
+/** \internal protects the following variables */
+static boost::mutex g_tracerMutex;
+
+/** \internal rings of all threads that recorded events */
+static std::vector< boost::shared_ptr< TraceRing > > g_traceRings;
+
+/** \internal size of new rings */
+static std::size_t g_nRecordsPerThread( 65536 );
+
+/** \internal interned names, index is id - 1 */
+static std::vector< std::string > g_traceNames;
+
+/** \internal ids of interned names */
+static std::map< std::string, unsigned > g_traceNameIds;
+
+/** \internal true once saveEnvironmentTrace() is registered to run at exit */
+static bool g_bSaveAtExit( false );
+
+
+void EventTracer::enable( std::size_t nRecordsPerThread )
+{
+	{
+		boost::mutex::scoped_lock l( g_tracerMutex );
+		g_nRecordsPerThread = std::max< std::size_t >( 1, nRecordsPerThread );
+	}
+
+	LOG4CPP_NOTICE( logger, "Event tracing enabled, " << nRecordsPerThread << " records per thread" );
+	s_bEnabled.store( true, boost::memory_order_release );
+}
+
+
+void EventTracer::disable()
+{
+	s_bEnabled.store( false, boost::memory_order_release );
+	LOG4CPP_NOTICE( logger, "Event tracing disabled" );
+}
+
+
+void EventTracer::clear()
+{
+	boost::mutex::scoped_lock l( g_tracerMutex );
+	for ( std::size_t i = 0; i < g_traceRings.size(); i++ )
+		g_traceRings[ i ]->nWritten.store( 0, boost::memory_order_release );
+}
+
+
+unsigned EventTracer::internName( const std::string& sName )
+{
+	boost::mutex::scoped_lock l( g_tracerMutex );
+	std::map< std::string, unsigned >::iterator it = g_traceNameIds.find( sName );
+	if ( it != g_traceNameIds.end() )
+		return it->second;
+
+	g_traceNames.push_back( sName );
+	unsigned id = static_cast< unsigned >( g_traceNames.size() );
+	g_traceNameIds[ sName ] = id;
+	return id;
+}
+
+
+void EventTracer::addRecord( RecordType type, unsigned portId, unsigned long long time,
+	unsigned long long duration, unsigned long long wait )
+{
+	TraceRing* pRing = g_pTraceRing.get();
+	if ( !pRing )
+	{
+		// first record of this thread
+		boost::mutex::scoped_lock l( g_tracerMutex );
+		g_traceRings.push_back( boost::shared_ptr< TraceRing >(
+			new TraceRing( g_nRecordsPerThread, static_cast< unsigned >( g_traceRings.size() + 1 ) ) ) );
+		pRing = g_traceRings.back().get();
+		g_pTraceRing.reset( pRing );
+	}
+
+	// only this thread writes to the ring
+	unsigned long long n = pRing->nWritten.load( boost::memory_order_relaxed );
+	Record& rRecord( pRing->records[ n % pRing->records.size() ] );
+	rRecord.time = time;
+	rRecord.duration = duration;
+	rRecord.wait = wait;
+	rRecord.portId = portId;
+	rRecord.type = type;
+	pRing->nWritten.store( n + 1, boost::memory_order_release );
+}
+
+
+/** \internal writes a name as JSON string */
+static void writeJsonString( std::ostream& out, const std::string& s )
+{
+	out << '"';
+	for ( std::string::const_iterator it = s.begin(); it != s.end(); it++ )
+		if ( *it == '"' || *it == '\\' )
+			out << '\\' << *it;
+		else if ( static_cast< unsigned char >( *it ) < 0x20 )
+			out << ' ';
+		else
+			out << *it;
+	out << '"';
+}
+
+
+/** \internal writes a time in microseconds relative to the start of the trace */
+static void writeTime( std::ostream& out, unsigned long long time, unsigned long long startTime )
+{
+	unsigned long long t = time > startTime ? time - startTime : 0;
+	out << t / 1000 << '.' << char( '0' + t / 100 % 10 ) << char( '0' + t / 10 % 10 ) << char( '0' + t % 10 );
+}
+
+
+void EventTracer::writeChromeTrace( std::ostream& out )
+{
+	// copy what is needed, so the mutex is not held while writing
+	std::vector< boost::shared_ptr< TraceRing > > rings;
+	std::vector< std::string > names;
+	{
+		boost::mutex::scoped_lock l( g_tracerMutex );
+		rings = g_traceRings;
+		names = g_traceNames;
+	}
+
+	// collect the valid records of each ring
+	std::vector< std::vector< Record > > records( rings.size() );
+	unsigned long long startTime = 0;
+	for ( std::size_t i = 0; i < rings.size(); i++ )
+	{
+		const std::size_t nSize = rings[ i ]->records.size();
+		const unsigned long long nWritten = rings[ i ]->nWritten.load( boost::memory_order_acquire );
+		for ( unsigned long long n = nWritten > nSize ? nWritten - nSize : 0; n < nWritten; n++ )
+		{
+			const Record& rRecord( rings[ i ]->records[ n % nSize ] );
+			records[ i ].push_back( rRecord );
+
+			unsigned long long recordStart = rRecord.type == trace_dispatch ? rRecord.time - rRecord.wait : rRecord.time;
+			if ( !startTime || recordStart < startTime )
+				startTime = recordStart;
+		}
+	}
+
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"threads\"}},\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"queue waits\"}}";
+
+	static const char* typeNames[] = { "enqueue", "dispatch", "drop", "expire", "pull" };
+	unsigned long long nWaits = 0;
+	for ( std::size_t i = 0; i < rings.size(); i++ )
+	{
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << rings[ i ]->threadId
+			<< ",\"args\":{\"name\":\"thread " << rings[ i ]->threadId << "\"}}";
+
+		for ( std::vector< Record >::const_iterator it = records[ i ].begin(); it != records[ i ].end(); it++ )
+		{
+			std::string sName( it->portId > 0 && it->portId <= names.size() ? names[ it->portId - 1 ] : "(unknown)" );
+
+			out << ",\n{\"name\":";
+			writeJsonString( out, sName );
+			out << ",\"cat\":\"" << typeNames[ it->type ] << "\",\"pid\":1,\"tid\":" << rings[ i ]->threadId << ",\"ts\":";
+			writeTime( out, it->time, startTime );
+			if ( it->type == trace_dispatch || it->type == trace_pull )
+			{
+				out << ",\"ph\":\"X\",\"dur\":";
+				writeTime( out, it->duration, 0 );
+			}
+			else
+				out << ",\"ph\":\"i\",\"s\":\"t\"";
+			out << "}";
+
+			// waiting times may overlap, so they are written as async spans
+			if ( it->type == trace_dispatch && it->wait )
+			{
+				nWaits++;
+				for ( int phase = 0; phase < 2; phase++ )
+				{
+					out << ",\n{\"name\":";
+					writeJsonString( out, sName );
+					out << ",\"cat\":\"wait\",\"pid\":2,\"tid\":" << it->portId << ",\"id\":" << nWaits
+						<< ",\"ph\":\"" << ( phase ? 'e' : 'b' ) << "\",\"ts\":";
+					writeTime( out, phase ? it->time : it->time - it->wait, startTime );
+					out << "}";
+				}
+			}
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+
+void EventTracer::writeChromeTrace( const std::string& sFileName )
+{
+	std::ofstream out( sFileName.c_str() );
+	if ( !out )
+		UBITRACK_THROW( "Cannot open event trace file " + sFileName );
+
+	writeChromeTrace( out );
+	LOG4CPP_NOTICE( logger, "Event trace written to " << sFileName );
+}
+
+
+void EventTracer::enableFromEnvironment()
+{
+	if ( !std::getenv( "UBITRACK_EVENT_TRACE" ) )
+		return;
+
+	{
+		// every event queue calls this, but the trace is only written once
+		boost::mutex::scoped_lock l( g_tracerMutex );
+		if ( !g_bSaveAtExit )
+		{
+			g_bSaveAtExit = true;
+			std::atexit( &EventTracer::saveEnvironmentTrace );
+		}
+	}
+
+	if ( !isEnabled() )
+		enable();
+}
+
+
+void EventTracer::saveEnvironmentTrace()
+{
+	const char* pFileName = std::getenv( "UBITRACK_EVENT_TRACE" );
+	if ( !pFileName )
+		return;
+
+	try
+	{
+		writeChromeTrace( std::string( pFileName ) );
+	}
+	catch ( const Ubitrack::Util::Exception& e )
+	{
+		LOG4CPP_ERROR( logger, e );
+	}
+}
+
+
+} } // namespace Ubitrack::Dataflow
@@ -0,0 +1,198 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Low-overhead binary tracing of dataflow events
+ */
+
+#ifndef __Ubitrack_Dataflow_EventTracer_INCLUDED__
+#define __Ubitrack_Dataflow_EventTracer_INCLUDED__
+
+#include <string>
+#include <ostream>
+#include <boost/atomic.hpp>
+#include <boost/utility.hpp>
+#include <utDataflow.h>
+#include <utMeasurement/Timestamp.h>
+#include "Port.h"
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * Records what happens to events in binary form, for latency debugging without the
+ * overhead of the \c Ubitrack.Events.* loggers.
+ *
+ * Each thread writes fixed-size records into its own ring buffer without locking, so only the
+ * most recent records of each thread are kept. Ports are identified by interned numbers, their
+ * names are only looked up when the trace is exported. When tracing is disabled, each trace
+ * point costs a single relaxed atomic load.
+ *
+ * The trace can be exported in the Chrome trace event format, which can be viewed in
+ * chrome://tracing or the Perfetto UI. Dispatches and pulls appear as spans on the threads that
+ * executed them, the time events waited in the queue as spans per port.
+ *
+ * Tracing can also be enabled by setting the environment variable UBITRACK_EVENT_TRACE to a
+ * file name. The trace is then written to that file when the process exits.
+ */
+class UTDATAFLOW_EXPORT EventTracer
+	: private boost::noncopyable
+{
+public:
+	/** kinds of trace records */
+	enum RecordType
+	{
+		/** an event was queued for a port */
+		trace_enqueue,
+
+		/** an event was dispatched to a port, with the dispatch time and the time it waited in the queue */
+		trace_dispatch,
+
+		/** an event for a port was dropped by the overflow policy */
+		trace_drop,
+
+		/** an event for a port was discarded because it was older than the maximum age */
+		trace_expire,
+
+		/** a measurement was pulled from a port, with the duration of the pull */
+		trace_pull
+	};
+
+	/** a trace record */
+	struct Record
+	{
+		/** time of the record, or start of the span */
+		unsigned long long time;
+
+		/** duration of the span, 0 for instant records */
+		unsigned long long duration;
+
+		/** time the event waited in the queue, for trace_dispatch */
+		unsigned long long wait;
+
+		/** interned id of the port, see Port::getTraceId() */
+		unsigned portId;
+
+		/** the kind of record */
+		RecordType type;
+	};
+
+	/**
+	 * Starts tracing.
+	 *
+	 * @param nRecordsPerThread size of the ring buffer of each thread that records events.
+	 *    Only applies to threads that did not record events before.
+	 */
+	static void enable( std::size_t nRecordsPerThread = 65536 );
+
+	/** stops tracing. The records are kept until clear() is called. */
+	static void disable();
+
+	/** true if tracing is enabled */
+	static bool isEnabled()
+	{ return s_bEnabled.load( boost::memory_order_relaxed ); }
+
+	/** removes all records. Should only be called while tracing is disabled. */
+	static void clear();
+
+	/**
+	 * Adds a record to the ring buffer of the calling thread. Does nothing if tracing is disabled.
+	 *
+	 * @param type the kind of record
+	 * @param rPort the port the record is about
+	 * @param time time of the record or start of the span
+	 * @param duration duration of the span
+	 * @param wait time the event waited in the queue
+	 */
+	static void trace( RecordType type, const Port& rPort, unsigned long long time,
+		unsigned long long duration = 0, unsigned long long wait = 0 )
+	{
+		if ( isEnabled() )
+			addRecord( type, rPort.getTraceId(), time, duration, wait );
+	}
+
+	/** returns a unique id for a name, used for the ids of ports */
+	static unsigned internName( const std::string& sName );
+
+	/**
+	 * Writes all records in the Chrome trace event format. Records written concurrently
+	 * may be inconsistent, so tracing should be disabled or the network stopped.
+	 */
+	static void writeChromeTrace( std::ostream& out );
+
+	/** writes all records in the Chrome trace event format to a file */
+	static void writeChromeTrace( const std::string& sFileName );
+
+	/** 
+	 * Enables tracing if the environment variable UBITRACK_EVENT_TRACE is set, and registers
+	 * saveEnvironmentTrace() to be called when the process exits. Called by each event queue.
+	 */
+	static void enableFromEnvironment();
+
+	/** writes the trace to the file given by the environment variable UBITRACK_EVENT_TRACE, if set */
+	static void saveEnvironmentTrace();
+
+	/**
+	 * Records the duration of a pull when it goes out of scope.
+	 * Does nothing if tracing was disabled when it was created.
+	 */
+	class PullScope
+		: private boost::noncopyable
+	{
+	public:
+		/** @param pPort the port that is pulled from, may be 0 */
+		PullScope( const Port* pPort )
+			: m_pPort( isEnabled() ? pPort : 0 )
+			, m_startTime( m_pPort ? Measurement::now() : 0 )
+		{}
+
+		~PullScope()
+		{
+			if ( m_pPort )
+				trace( trace_pull, *m_pPort, m_startTime, Measurement::now() - m_startTime );
+		}
+
+	protected:
+		/** the port that is pulled from, 0 if not tracing */
+		const Port* m_pPort;
+
+		/** start of the pull */
+		unsigned long long m_startTime;
+	};
+
+protected:
+	/** writes a record into the ring buffer of the calling thread */
+	static void addRecord( RecordType type, unsigned portId, unsigned long long time,
+		unsigned long long duration, unsigned long long wait );
+
+	/** is tracing enabled? */
+	static boost::atomic< bool > s_bEnabled;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
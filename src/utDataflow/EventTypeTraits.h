@@ -28,6 +28,7 @@
  * The traits tell for each type
  * - how the get the event queue priority
  * - the maximum queue length for events of that type
+ * - the maximum age of events of that type
  *
  * @author Daniel Pustka <daniel.pustka@in.tum.de>
  */
@@ -48,6 +49,14 @@ static const int g_defaultMaxQueueLength =
 	7; // 7 is the default, if not overriden by compiler options
 #endif
 
+/** default maximum age of events in nanoseconds for all data types, 0 if events never expire */
+static const unsigned long long g_defaultMaxEventAge = 
+#ifdef MAXIMUM_EVENT_AGE
+	MAXIMUM_EVENT_AGE;
+#else
+	0; // events do not expire, if not overriden by compiler options
+#endif
+
 /**
  * \internal
  * Defines how to extract the priority out of a data type.
@@ -61,6 +70,9 @@ struct EventTypeTraits
 	
 	int getMaxQueueLength() const
 	{ return g_defaultMaxQueueLength; }
+
+	unsigned long long getMaxAge() const
+	{ return g_defaultMaxEventAge; }
 };
 
 // traits that tell the event queue how to treat measurements
@@ -80,6 +92,9 @@ struct EventTypeTraits< Measurement::Measurement< T > >
 
 	int getMaxQueueLength() const
 	{ return g_defaultMaxQueueLength; }
+
+	unsigned long long getMaxAge() const
+	{ return g_defaultMaxEventAge; }
 };
 
 /**
@@ -94,6 +109,27 @@ struct EventTypeTraits< Measurement::Button >
 
 	int getMaxQueueLength() const
 	{ return -1; } // unlimited queue length
+
+	unsigned long long getMaxAge() const
+	{ return 0; } // never expire
+};
+
+/**
+ * \internal
+ * Tells if copies of an event share its payload. Push suppliers then give each consumer its own
+ * copy instead of sharing one deep copy between them, see PushSupplierCore::send().
+ * Measurements are reference counted, so their copies are shallow.
+ */
+template< typename T >
+struct EventSharesPayload
+{
+	static const bool value = false;
+};
+
+template< typename T >
+struct EventSharesPayload< Measurement::Measurement< T > >
+{
+	static const bool value = true;
 };
 
 } } // namespace Ubitrack::Dataflow
@@ -87,6 +87,9 @@ public:
 	/** pull an event from a connected pushSupplier */
 	void pull( Measurement::Timestamp );
 
+	/** like pull(), but returns false if no measurement is available */
+	bool tryPull( Measurement::Timestamp );
+
 	/** If the port is time expanded, add the stored measurement to the list. */
 	void storeMeasurement();
 
@@ -268,6 +271,38 @@ void ExpansionInPort< EventType >::pull( Measurement::Timestamp t )
 }
 
 
+template< class EventType >
+bool ExpansionInPort< EventType >::tryPull( Measurement::Timestamp t )
+{
+	LOG4CPP_DEBUG( m_logger, fullName() << " tryPull");
+	assert( !m_bPush );
+
+	if ( m_slaves.empty() )
+	{
+		bool bFound;
+		if ( PullConsumerCore< SingleEvent >::m_pullSupplier )
+			bFound = PullConsumerCore< SingleEvent >::tryGet( t, m_singleMeasurement );
+		else
+			bFound = PullConsumerCore< VectorEvent >::tryGet( t, m_vectorMeasurement );
+
+		if ( !bFound )
+		{
+			LOG4CPP_DEBUG( m_logger, fullName() << " no measurement at " << t );
+			return false;
+		}
+	}
+	else if ( m_timestamp != t )
+	{
+		// port duplication space expansion has no measurement for this timestamp
+		LOG4CPP_DEBUG( m_logger, fullName() << " wrong timestamp for port duplication space expansion, t=" << t << ", m_timestamp=" << m_timestamp );
+		return false;
+	}
+
+	m_timestamp = t;
+	return true;
+}
+
+
 template< class EventType >
 void ExpansionInPort< EventType >::storeMeasurement()
 {
@@ -335,12 +370,13 @@ void ExpansionInPort< EventType >::connect( Port& rOther )
 		{			
 			PullConsumerCore< VectorEvent >::setPullSupplier( rOther, &rOther.getComponent().getMutex() );
 		}
+		m_rComponent.addPullSource( rOther.getComponent() );
 	}
 }
 
 
 template< class EventType >
-void ExpansionInPort< EventType >::disconnect( Port& )
+void ExpansionInPort< EventType >::disconnect( Port& rOther )
 {
 	if ( !isPush() )
 	{
@@ -352,6 +388,7 @@ void ExpansionInPort< EventType >::disconnect( Port& )
 		{
 			PullConsumerCore< VectorEvent >::removePullSupplier();
 		}
+		m_rComponent.removePullSource( rOther.getComponent() );
 	}
 }
 
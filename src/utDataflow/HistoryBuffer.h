@@ -0,0 +1,213 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Header file for \c HistoryBuffer, a time-indexed buffer of the last measurements
+ */
+
+#ifndef __Ubitrack_Dataflow_HistoryBuffer_INCLUDED__
+#define __Ubitrack_Dataflow_HistoryBuffer_INCLUDED__
+
+#include <algorithm>
+#include <boost/circular_buffer.hpp>
+#include <utMeasurement/Timestamp.h>
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * Stores the last measurements sorted by timestamp in a ring buffer of fixed capacity.
+ *
+ * Lookups use binary search. Measurements arriving in order are appended in constant time,
+ * older ones are inserted at their position. When the buffer is full, the oldest measurement
+ * is dropped. The buffer is not synchronized, ports using it lock their component.
+ *
+ * @param EventType type of the stored measurements, must have a \c time() method
+ */
+template< class EventType >
+class HistoryBuffer
+{
+public:
+	/** @param nCapacity maximum number of stored measurements */
+	HistoryBuffer( std::size_t nCapacity = 1 )
+		: m_buffer( std::max< std::size_t >( 1, nCapacity ) )
+	{}
+
+	/** changes the maximum number of stored measurements, keeping the newest ones */
+	void setCapacity( std::size_t nCapacity )
+	{ m_buffer.rset_capacity( std::max< std::size_t >( 1, nCapacity ) ); }
+
+	/** returns the maximum number of stored measurements */
+	std::size_t capacity() const
+	{ return m_buffer.capacity(); }
+
+	/** returns the number of stored measurements */
+	std::size_t size() const
+	{ return m_buffer.size(); }
+
+	/** returns true if no measurements are stored */
+	bool empty() const
+	{ return m_buffer.empty(); }
+
+	/** removes all measurements */
+	void clear()
+	{ m_buffer.clear(); }
+
+	/** returns the oldest measurement. The buffer must not be empty. */
+	const EventType& oldest() const
+	{ return m_buffer.front(); }
+
+	/** returns the newest measurement. The buffer must not be empty. */
+	const EventType& newest() const
+	{ return m_buffer.back(); }
+
+	/**
+	 * Stores a measurement. A measurement with the same timestamp as a stored one replaces it.
+	 *
+	 * @return false if the buffer is full and the measurement is older than all stored ones
+	 */
+	bool insert( const EventType& e )
+	{
+		// usual case: measurements arrive in order
+		if ( m_buffer.empty() || m_buffer.back().time() < e.time() )
+		{
+			m_buffer.push_back( e );
+			return true;
+		}
+
+		typename BufferType::iterator it = std::lower_bound( m_buffer.begin(), m_buffer.end(), e.time(), TimeLess() );
+		if ( it != m_buffer.end() && it->time() == e.time() )
+		{
+			*it = e;
+			return true;
+		}
+
+		if ( m_buffer.full() && it == m_buffer.begin() )
+			return false;
+
+		// drops the oldest measurement if the buffer is full
+		m_buffer.insert( it, e );
+		return true;
+	}
+
+	/**
+	 * Finds the measurement with the given timestamp.
+	 *
+	 * @param t timestamp of the measurement
+	 * @param result receives the measurement, unchanged if none is found
+	 * @return true if a measurement was found
+	 */
+	bool find( Measurement::Timestamp t, EventType& result ) const
+	{
+		typename BufferType::const_iterator it = std::lower_bound( m_buffer.begin(), m_buffer.end(), t, TimeLess() );
+		if ( it == m_buffer.end() || it->time() != t )
+			return false;
+
+		result = *it;
+		return true;
+	}
+
+	/**
+	 * Finds the measurement closest in time.
+	 *
+	 * @param t the timestamp
+	 * @param result receives the measurement, unchanged if none is found
+	 * @param maxDistance maximum time difference in nanoseconds
+	 * @return true if a measurement within \c maxDistance was found
+	 */
+	bool findNearest( Measurement::Timestamp t, EventType& result,
+		Measurement::Timestamp maxDistance = ~Measurement::Timestamp( 0 ) ) const
+	{
+		if ( m_buffer.empty() )
+			return false;
+
+		typename BufferType::const_iterator it = std::lower_bound( m_buffer.begin(), m_buffer.end(), t, TimeLess() );
+		if ( it == m_buffer.end() || ( it != m_buffer.begin() && t - ( it - 1 )->time() < it->time() - t ) )
+			it--;
+
+		if ( distance( it->time(), t ) > maxDistance )
+			return false;
+
+		result = *it;
+		return true;
+	}
+
+	/**
+	 * Finds the measurements immediately before and after a timestamp, e.g. for interpolation.
+	 * If a measurement has exactly the given timestamp, it is returned as both.
+	 *
+	 * @param t the timestamp
+	 * @param before receives the newest measurement not after \c t
+	 * @param after receives the oldest measurement not before \c t
+	 * @return false if \c t is not between the oldest and newest measurement. Then the results are unchanged.
+	 */
+	bool findBracketing( Measurement::Timestamp t, EventType& before, EventType& after ) const
+	{
+		typename BufferType::const_iterator it = std::lower_bound( m_buffer.begin(), m_buffer.end(), t, TimeLess() );
+		if ( it == m_buffer.end() )
+			return false;
+
+		if ( it->time() == t )
+		{
+			before = *it;
+			after = *it;
+			return true;
+		}
+
+		if ( it == m_buffer.begin() )
+			return false;
+
+		before = *( it - 1 );
+		after = *it;
+		return true;
+	}
+
+protected:
+	/** type of the ring buffer */
+	typedef boost::circular_buffer< EventType > BufferType;
+
+	/** compares measurements with timestamps for binary search */
+	struct TimeLess
+	{
+		bool operator()( const EventType& e, Measurement::Timestamp t ) const
+		{ return e.time() < t; }
+
+		bool operator()( Measurement::Timestamp t, const EventType& e ) const
+		{ return t < e.time(); }
+	};
+
+	/** absolute difference of two timestamps */
+	static Measurement::Timestamp distance( Measurement::Timestamp a, Measurement::Timestamp b )
+	{ return a < b ? b - a : a - b; }
+
+	/** the measurements, sorted by timestamp */
+	BufferType m_buffer;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
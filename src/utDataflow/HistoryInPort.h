@@ -0,0 +1,186 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Header file for \c HistoryInPort, an input port of triggered components that converts pushed measurements to pulled ones
+ */
+
+#ifndef __UBITRACK_DATAFLOW_HISTORYINPORT_H_INCLUDED__
+#define __UBITRACK_DATAFLOW_HISTORYINPORT_H_INCLUDED__
+
+#include "TriggerComponent.h"
+#include "PushConsumer.h"
+#include "HistoryBuffer.h"
+#include <utMeasurement/Measurement.h>
+#include <log4cpp/Category.hh>
+#include <boost/bind.hpp>
+
+namespace Ubitrack { namespace Dataflow {
+
+/**
+ * @ingroup dataflow_framework
+ *
+ * Input port of a \c TriggerComponent that stores pushed measurements in a \c HistoryBuffer
+ * and supplies them to its trigger group as if they were pulled.
+ *
+ * Received measurements never trigger the component. When another input port or a pull on a
+ * \c TriggerOutPort triggers the computation for a timestamp, the port looks up the measurement
+ * with that timestamp or, if a tolerance is set, the nearest one within the tolerance. If there
+ * is none, the component does not compute. Components can also query the history directly,
+ * e.g. for the measurements bracketing a timestamp to interpolate.
+ *
+ * The connected supplier must push. The size of the history and the tolerance can be set from
+ * UTQL with the "historySize" and "historyTolerance" (in milliseconds) edge attributes, see
+ * DataflowNetwork::configureHistories().
+ *
+ * @param EventType type of events to be passed over this port
+ */
+template< class EventType >
+class HistoryInPort
+	: public TriggerInPortBase
+	, public PushConsumerCore< EventType >
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param sName name of the port
+	 * @param rParent reference to the \c TriggerComponent this port belongs to
+	 * @param nSamples default number of stored measurements
+	 * @param maxDistance default maximum time difference in nanoseconds of a measurement used for a timestamp
+	 * @param triggerGroup id of the trigger group for this port
+	 */
+	HistoryInPort( const std::string& sName, TriggerComponent& rParent, std::size_t nSamples = 1,
+		Measurement::Timestamp maxDistance = 0, int triggerGroup = 0 );
+
+	/** retrieves the measurement selected by the last trigger */
+	const EventType& get() const
+	{ return m_measurement; }
+
+	/** returns the stored measurements. The component mutex must be locked. */
+	const HistoryBuffer< EventType >& getHistory() const
+	{ return m_history; }
+
+	/** look up the measurement for a timestamp, throw if there is none */
+	void pull( Measurement::Timestamp t );
+
+	/** look up the measurement for a timestamp, return false if there is none */
+	bool tryPull( Measurement::Timestamp t );
+
+	//@{
+	/** implements the Port interface */
+	void setHistory( std::size_t nSamples, unsigned long long maxDistance );
+	std::size_t getHistorySize() const;
+	unsigned long long getHistoryTolerance() const;
+	//@}
+
+protected:
+	/** called when an event is pushed in */
+	void receivePush( const EventType& );
+
+	/** the stored measurements */
+	HistoryBuffer< EventType > m_history;
+
+	/** maximum time difference of a measurement used for a timestamp */
+	Measurement::Timestamp m_maxDistance;
+
+	/** the measurement selected by the last trigger */
+	EventType m_measurement;
+
+	/** for logging */
+	log4cpp::Category& m_logger;
+};
+
+
+template< class EventType >
+HistoryInPort< EventType >::HistoryInPort( const std::string& sName, TriggerComponent& rParent, std::size_t nSamples,
+	Measurement::Timestamp maxDistance, int triggerGroup )
+	: TriggerInPortBase( sName, rParent, triggerGroup, false, true )
+	, PushConsumerCore< EventType >( *this, boost::bind( &HistoryInPort< EventType >::receivePush, this, _1 ), &rParent.getMutex() )
+	, m_history( nSamples )
+	, m_maxDistance( maxDistance )
+	, m_logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.HistoryInPort" ) )
+{}
+
+
+template< class EventType >
+void HistoryInPort< EventType >::pull( Measurement::Timestamp t )
+{
+	if ( !tryPull( t ) )
+		UBITRACK_THROW( fullName() + ": no measurement in history for requested timestamp" );
+}
+
+
+template< class EventType >
+bool HistoryInPort< EventType >::tryPull( Measurement::Timestamp t )
+{
+	bool bFound = m_maxDistance ? m_history.findNearest( t, m_measurement, m_maxDistance ) : m_history.find( t, m_measurement );
+	if ( !bFound )
+	{
+		LOG4CPP_DEBUG( m_logger, fullName() << " no measurement in history at " << t );
+		return false;
+	}
+	m_timestamp = m_measurement.time();
+
+	LOG4CPP_DEBUG( m_logger, fullName() << " found measurement at " << m_timestamp << " for " << t );
+	return true;
+}
+
+
+template< class EventType >
+void HistoryInPort< EventType >::setHistory( std::size_t nSamples, unsigned long long maxDistance )
+{
+	Component::MutexType::scoped_lock l( m_rComponent.getMutex() );
+	m_history.setCapacity( nSamples );
+	m_maxDistance = maxDistance;
+}
+
+
+template< class EventType >
+std::size_t HistoryInPort< EventType >::getHistorySize() const
+{
+	return m_history.capacity();
+}
+
+
+template< class EventType >
+unsigned long long HistoryInPort< EventType >::getHistoryTolerance() const
+{
+	return m_maxDistance;
+}
+
+
+template< class EventType >
+void HistoryInPort< EventType >::receivePush( const EventType& e )
+{
+	LOG4CPP_DEBUG( m_logger, fullName() << " received measurement at " << e.time() );
+
+	if ( !m_history.insert( e ) )
+		LOG4CPP_DEBUG( m_logger, fullName() << " dropped measurement at " << e.time() << ", older than history" );
+}
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
@@ -30,9 +30,11 @@
  */ 
 
 #include <stdexcept>
+#include <utUtil/Exception.h>
 
 #include "Port.h"
 #include "Component.h"
+#include "EventTracer.h"
 
 namespace Ubitrack { namespace Dataflow {
 
@@ -40,6 +42,8 @@ namespace Ubitrack { namespace Dataflow {
 Port::Port( const std::string &sName, Component& rComponent )
 	: m_sName( sName )
 	, m_rComponent( rComponent )
+	, m_pEventQueue( 0 )
+	, m_traceId( 0 )
 { 
 	m_rComponent.addPort( m_sName, this );
 }
@@ -51,6 +55,19 @@ Port::~Port()
 }
 
 
+unsigned Port::getTraceId() const
+{
+	unsigned id = m_traceId.load( boost::memory_order_relaxed );
+	if ( !id )
+	{
+		// interning the full name gives the same id if several threads get here
+		id = EventTracer::internName( fullName() );
+		m_traceId.store( id, boost::memory_order_relaxed );
+	}
+	return id;
+}
+
+
 void Port::connect( Port& )
 { 
 	// default implementation that does nothing
@@ -63,4 +80,35 @@ void Port::disconnect( Port& )
 }
 
 
+void Port::setQueuePolicy( int nMaxQueueLength, EventQueue::OverflowPolicy policy )
+{
+	for ( ReceiverInfoList::iterator it = m_receiverInfos.begin(); it != m_receiverInfos.end(); it++ )
+	{
+		(*it)->nMaxQueueLength = nMaxQueueLength;
+		(*it)->overflowPolicy = policy;
+		if ( nMaxQueueLength > 0 && (*it)->pendingEvents.capacity() < static_cast< std::size_t >( nMaxQueueLength ) )
+			(*it)->pendingEvents.set_capacity( nMaxQueueLength );
+	}
+}
+
+
+void Port::setMaxEventAge( unsigned long long maxAge )
+{
+	for ( ReceiverInfoList::iterator it = m_receiverInfos.begin(); it != m_receiverInfos.end(); it++ )
+		(*it)->maxAge = maxAge;
+}
+
+
+void Port::setPullCacheSize( std::size_t )
+{
+	UBITRACK_THROW( "Port " + fullName() + " does not supply pulled events and cannot cache them" );
+}
+
+
+void Port::setHistory( std::size_t, unsigned long long )
+{
+	UBITRACK_THROW( "Port " + fullName() + " does not keep a history of measurements" );
+}
+
+
 } } // namespace Ubitrack::Dataflow
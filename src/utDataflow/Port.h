@@ -33,9 +33,11 @@
 #define __Ubitrack_Dataflow_Port_INCLUDED__
 
 #include <string>
+#include <vector>
 #include <boost/utility.hpp>
 #include <utDataflow.h>
 #include "Component.h"
+#include "EventQueue.h"
 
 namespace Ubitrack { namespace Dataflow {
 
@@ -69,6 +71,9 @@ public:
 	std::string fullName() const
 	{ return m_rComponent.getName() + ":" + m_sName; }
 	
+	/** returns the id of the port in event traces, see EventTracer */
+	unsigned getTraceId() const;
+
 	/** returns a reference to the component that this port belongs to */
 	Component& getComponent() const
 	{ return m_rComponent; }
@@ -88,6 +93,72 @@ public:
 	 * @param rOther The port to disconnect from.
 	 */
 	virtual void disconnect( Port& rOther );
+
+	/** type of list of event receivers */
+	typedef std::vector< EventQueue::ReceiverInfo* > ReceiverInfoList;
+
+	/** 
+	 * Registers an event receiver of this port. Called by ports that receive pushed events.
+	 * The receiver must live as long as the port.
+	 */
+	void addReceiverInfo( EventQueue::ReceiverInfo* pReceiverInfo )
+	{ m_receiverInfos.push_back( pReceiverInfo ); }
+
+	/** returns the event receivers of this port, empty if the port does not receive pushed events */
+	const ReceiverInfoList& getReceiverInfos() const
+	{ return m_receiverInfos; }
+
+	/**
+	 * Changes the queueing behaviour of all event receivers of this port.
+	 * Must not be called while events for this port are queued.
+	 *
+	 * @param nMaxQueueLength maximum number of queued events, negative for unlimited queueing
+	 * @param policy what to do if the maximum number of events is reached
+	 */
+	void setQueuePolicy( int nMaxQueueLength, EventQueue::OverflowPolicy policy );
+
+	/**
+	 * Changes the maximum age of events for all event receivers of this port.
+	 *
+	 * @param maxAge maximum age in nanoseconds, 0 if events never expire
+	 */
+	void setMaxEventAge( unsigned long long maxAge );
+
+	/**
+	 * Sets the event queue that delivers events to this port.
+	 * Set by the data flow network when the port is connected.
+	 */
+	void setEventQueue( EventQueue& rEventQueue )
+	{ m_pEventQueue = &rEventQueue; }
+
+	/**
+	 * Enables caching of pulled results by timestamp, see PullSupplierCore::setCacheSize().
+	 * Must be called before the port is connected. Throws if the port does not supply pulled events.
+	 *
+	 * @param nEntries number of cached timestamps, 0 disables the cache
+	 */
+	virtual void setPullCacheSize( std::size_t nEntries );
+
+	/**
+	 * Changes the history of measurements kept by the port, see HistoryInPort.
+	 * Throws if the port does not keep a history.
+	 *
+	 * @param nSamples number of stored measurements
+	 * @param maxDistance maximum time difference in nanoseconds of a measurement used for a requested timestamp
+	 */
+	virtual void setHistory( std::size_t nSamples, unsigned long long maxDistance );
+
+	/** returns the number of measurements kept by the port, 0 if the port does not keep a history */
+	virtual std::size_t getHistorySize() const
+	{ return 0; }
+
+	/** returns the tolerance of history lookups in nanoseconds, 0 if the port does not keep a history */
+	virtual unsigned long long getHistoryTolerance() const
+	{ return 0; }
+
+	/** returns the event queue that delivers events to this port, by default the global event queue */
+	EventQueue& getEventQueue() const
+	{ return m_pEventQueue ? *m_pEventQueue : EventQueue::singleton(); }
 	
 protected:
 	/** the name of the port */
@@ -95,6 +166,15 @@ protected:
 	
 	/** reference to the component that owns this port */
 	Component& m_rComponent;
+
+	/** event receivers of this port */
+	ReceiverInfoList m_receiverInfos;
+
+	/** the event queue of this port, 0 for the global event queue */
+	EventQueue* m_pEventQueue;
+
+	/** id of the port in event traces, 0 until first used */
+	mutable boost::atomic< unsigned > m_traceId;
 }; 
 
 
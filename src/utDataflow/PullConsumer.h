@@ -34,10 +34,13 @@
 
 #include <string>
 #include <typeinfo>
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "Port.h"
 #include "PullSupplier.h"
+#include "PullThreadPool.h"
+#include "EventTracer.h"
 #include <utMeasurement/Timestamp.h>
 #include <utUtil/Exception.h>
 
@@ -57,6 +60,12 @@ class Component;
 template< class EventType > class PullConsumerCore
 {
 public:
+	/** constructor */
+	PullConsumerCore()
+		: m_pMutex( 0 )
+		, m_pSupplierPort( 0 )
+	{}
+
 	/**
 	 * Queries a measurement from the connected supplier.
 	 * Throws a \c Ubitrack::Util::Exception if unconnected
@@ -70,17 +79,85 @@ public:
 		if ( !m_pullSupplier )
 			UBITRACK_THROW( "PullConsumer not connected" );
 
+		EventTracer::PullScope trace( m_pSupplierPort );
+
 		// fetch and return a result from supplier
 		if ( m_pMutex )
 		{
 			MutexType::scoped_lock l( *m_pMutex );
+			Component::LockedScope locked( m_pMutex );
 			return m_pullSupplier( t );
 		}
 		else
 			return m_pullSupplier( t );
 	}
 
+	/**
+	 * Queries a measurement from the connected supplier without throwing if no measurement
+	 * is available. Throws a \c Ubitrack::Util::Exception if unconnected or on real errors.
+	 *
+	 * @param t time the measurement is requested for
+	 * @param result receives the measurement, unchanged if none is available
+	 * @return true if a measurement is available
+	 */
+	bool tryGet( Ubitrack::Measurement::Timestamp t, EventType& result )
+	{
+		// check if connected
+		if ( !m_tryPullSupplier )
+			UBITRACK_THROW( "PullConsumer not connected" );
+
+		EventTracer::PullScope trace( m_pSupplierPort );
+
+		if ( m_pMutex )
+		{
+			MutexType::scoped_lock l( *m_pMutex );
+			Component::LockedScope locked( m_pMutex );
+			return m_tryPullSupplier( t, result );
+		}
+		else
+			return m_tryPullSupplier( t, result );
+	}
+
+	/**
+	 * Queries a measurement asynchronously using the PullThreadPool. The consumer must not be 
+	 * disconnected or destroyed before the result was retrieved with PullFuture::get(), which
+	 * throws if the pull failed.
+	 *
+	 * A pool thread would deadlock if it had to lock a component the calling thread holds while
+	 * the calling thread waits for the result, e.g. when the supplier pulls from a component that
+	 * is delivering an event in the calling thread. Such pulls are not queued, but executed by 
+	 * PullFuture::get() in the calling thread. Components locked by other means than event 
+	 * delivery and pulls, e.g. explicitly with Component::getMutex(), are not detected and must 
+	 * not be held while waiting for a result.
+	 *
+	 * @param t time the measurement is requested for
+	 * @return the future result
+	 */
+	PullFuture< EventType > getAsync( Ubitrack::Measurement::Timestamp t )
+	{
+		boost::shared_ptr< EventType > pResult( new EventType );
+		boost::shared_ptr< PullTask > pTask( new PullTask( 
+			boost::bind( &PullConsumerCore< EventType >::getInto, this, t, pResult ) ) );
+		if ( !isSupplierLockedByThisThread() )
+			PullThreadPool::singleton().submit( pTask );
+		return PullFuture< EventType >( pTask, pResult );
+	}
+
+	/**
+	 * Returns true if the calling thread delivers an event or a pull to the supplier or a component
+	 * it pulls from, so the pull must not be executed by another thread the caller waits for.
+	 */
+	bool isSupplierLockedByThisThread() const
+	{
+		return m_pSupplierPort && ( Component::isLockedByThisThread( m_pMutex ) ||
+			m_pSupplierPort->getComponent().isPullSourceLockedByThisThread() );
+	}
+
 protected:
+	/** pulls into a result of getAsync() */
+	void getInto( Ubitrack::Measurement::Timestamp t, boost::shared_ptr< EventType > pResult )
+	{ *pResult = get( t ); }
+
 	/** type of mutex to lock */
 	typedef boost::recursive_mutex MutexType;
 
@@ -96,9 +173,15 @@ protected:
 
 	/** the supplier function */
 	typename PullSupplierCore< EventType >::FunctionType m_pullSupplier;
+
+	/** the non-throwing supplier function */
+	typename PullSupplierCore< EventType >::TryFunctionType m_tryPullSupplier;
 	
 	/** pointer to mutex to lock before calling */
 	MutexType* m_pMutex;
+
+	/** the supplier port, for event traces */
+	const Port* m_pSupplierPort;
 };
 
 
@@ -113,8 +196,11 @@ void PullConsumerCore< EventType >::setPullSupplier( OtherSide& rSupplier, typen
 	try
 	{
 		// store pointer to supplier function
-		m_pullSupplier = dynamic_cast< PullSupplierCore< EventType >& >( rSupplier ).getFunction();
+		PullSupplierCore< EventType >& rSupplierCore( dynamic_cast< PullSupplierCore< EventType >& >( rSupplier ) );
+		m_pullSupplier = rSupplierCore.getFunction();
+		m_tryPullSupplier = rSupplierCore.getTryFunction();
 		m_pMutex = pMutex;
+		m_pSupplierPort = &rSupplier;
 	}
 	catch ( const std::bad_cast&)
 	{
@@ -131,7 +217,9 @@ void PullConsumerCore< EventType >::removePullSupplier()
 {
 	// clear function pointer
 	m_pullSupplier.clear();
+	m_tryPullSupplier.clear();
 	m_pMutex = 0;
+	m_pSupplierPort = 0;
 }
 
 
@@ -176,6 +264,7 @@ template< class EventType >
 void PullConsumer< EventType >::connect( Port& rOther )
 {
 	PullConsumerCore< EventType >::setPullSupplier( rOther, &rOther.getComponent().getMutex() );
+	m_rComponent.addPullSource( rOther.getComponent() );
 }
 
 
@@ -183,6 +272,7 @@ template< class EventType >
 void PullConsumer< EventType >::disconnect( Port& rOther )
 {
 	PullConsumerCore< EventType >::removePullSupplier();
+	m_rComponent.removePullSource( rOther.getComponent() );
 }
 
 
@@ -32,11 +32,16 @@
 #ifndef __Ubitrack_Dataflow_PullSupplier_INCLUDED__
 #define __Ubitrack_Dataflow_PullSupplier_INCLUDED__
 
+#include <vector>
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "Port.h"
 #include <utMeasurement/Timestamp.h>
+#include <utUtil/Exception.h>
+#include <log4cpp/Category.hh>
 
 namespace Ubitrack { namespace Dataflow {
 
@@ -45,6 +50,17 @@ namespace Ubitrack { namespace Dataflow {
  * Implements the core functionality of a pull supplier.
  * Used by the PullSupplier port and other ports.
  *
+ * Optionally, the results of the last pulls are cached by timestamp, so several consumers
+ * pulling the same timestamp, e.g. in diamond-shaped pull graphs, compute it only once.
+ * Cached results are discarded when a pushed event has been delivered to the component of the
+ * supplier or to a component it pulls from, see Component::getPushGeneration().
+ *
+ * Besides the function that throws a \c Ubitrack::Util::Exception if no measurement is
+ * available, suppliers can provide a function that returns false instead, which is used by
+ * PullConsumerCore::tryGet(). Exceptions are then only thrown for real errors. Without such a 
+ * function, tryGet() calls the throwing one and treats a \c Ubitrack::Util::Exception as "no 
+ * measurement", logging its reason, which is slower and cannot tell real errors apart.
+ *
  * @param EventType type of measurements to be queried
  */
 template< class EventType > class PullSupplierCore
@@ -53,18 +69,191 @@ public:
 	/** type of function pointers used to define callbacks */
 	typedef boost::function< EventType( Ubitrack::Measurement::Timestamp ) > FunctionType;
 
-	/** constructor */
-	PullSupplierCore( const FunctionType& function )
+	/** 
+	 * type of callbacks that do not throw if no measurement is available. They return false 
+	 * in this case and leave the result unchanged.
+	 */
+	typedef boost::function< bool ( Ubitrack::Measurement::Timestamp, EventType& ) > TryFunctionType;
+
+	/**
+	 * constructor
+	 *
+	 * @param function callback that throws if no measurement is available
+	 * @param tryFunction optional callback that returns false instead. If empty, \c function is used.
+	 */
+	PullSupplierCore( const FunctionType& function, const TryFunctionType& tryFunction = TryFunctionType() )
 		: m_function( function )
+		, m_tryFunction( tryFunction )
+		, m_pComponent( 0 )
+		, m_nCacheNext( 0 )
+		, m_nCacheHits( 0 )
+		, m_nCacheMisses( 0 )
 	{}
 
-	/** returns the stored function pointer */
-	const FunctionType& getFunction() const
-	{ return m_function; }
+	/** returns the function to be called by consumers, which uses the cache if it is enabled */
+	FunctionType getFunction() const
+	{
+		if ( m_cache.empty() )
+			return m_function;
+		return boost::bind( &PullSupplierCore< EventType >::cachedPull, this, _1 );
+	}
+
+	/** returns the non-throwing function to be called by consumers, which uses the cache if it is enabled */
+	TryFunctionType getTryFunction() const
+	{
+		if ( !m_cache.empty() )
+			return boost::bind( &PullSupplierCore< EventType >::cachedTryPull, this, _1, _2 );
+		return boost::bind( &PullSupplierCore< EventType >::tryPull, this, _1, _2 );
+	}
+
+	/**
+	 * Enables caching of pulled results. Must be called before the port is connected, 
+	 * consumers connected earlier do not use the cache.
+	 *
+	 * @param nEntries number of cached timestamps, 0 disables the cache
+	 * @param rComponent the component computing the results, whose push generation invalidates the cache
+	 */
+	void setCacheSize( std::size_t nEntries, const Component& rComponent )
+	{
+		boost::mutex::scoped_lock l( m_cacheMutex );
+		m_cache.assign( nEntries, CacheEntry() );
+		m_nCacheNext = 0;
+		m_pComponent = &rComponent;
+	}
+
+	/** returns the number of pulls answered from the cache */
+	unsigned long long getCacheHits() const
+	{
+		boost::mutex::scoped_lock l( m_cacheMutex );
+		return m_nCacheHits;
+	}
+
+	/** returns the number of pulls that were computed while the cache was enabled */
+	unsigned long long getCacheMisses() const
+	{
+		boost::mutex::scoped_lock l( m_cacheMutex );
+		return m_nCacheMisses;
+	}
 
 protected:
+	/** calls the non-throwing function, or the throwing one if there is none */
+	bool tryPull( Ubitrack::Measurement::Timestamp t, EventType& result ) const
+	{
+		if ( m_tryFunction )
+			return m_tryFunction( t, result );
+
+		try
+		{
+			result = m_function( t );
+			return true;
+		}
+		catch ( const Ubitrack::Util::Exception& e )
+		{
+			// without a try function, no measurement cannot be told apart from other errors
+			static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.PullSupplier" ) );
+			LOG4CPP_DEBUG( logger, "no measurement at " << t << ", pull failed: " << e );
+			return false;
+		}
+	}
+
+	/** calls the function if the result for the timestamp is not in the cache */
+	EventType cachedPull( Ubitrack::Measurement::Timestamp t ) const
+	{
+		// read the generation first, so a result computed during a push is not used later
+		const unsigned long long nGeneration( m_pComponent->getPushGeneration() );
+		EventType event;
+		if ( findCached( t, nGeneration, event ) )
+			return event;
+
+		// not locked, the function may pull recursively
+		event = m_function( t );
+		storeCached( t, nGeneration, event );
+		return event;
+	}
+
+	/** calls the non-throwing function if the result for the timestamp is not in the cache */
+	bool cachedTryPull( Ubitrack::Measurement::Timestamp t, EventType& result ) const
+	{
+		const unsigned long long nGeneration( m_pComponent->getPushGeneration() );
+		if ( findCached( t, nGeneration, result ) )
+			return true;
+
+		if ( !tryPull( t, result ) )
+			return false;
+		storeCached( t, nGeneration, result );
+		return true;
+	}
+
+	/** looks up a result in the cache and counts hits and misses */
+	bool findCached( Ubitrack::Measurement::Timestamp t, unsigned long long nGeneration, EventType& result ) const
+	{
+		boost::mutex::scoped_lock l( m_cacheMutex );
+		for ( typename std::vector< CacheEntry >::const_iterator it = m_cache.begin(); it != m_cache.end(); it++ )
+			if ( it->bValid && it->nGeneration == nGeneration && it->time == t )
+			{
+				m_nCacheHits++;
+				result = it->event;
+				return true;
+			}
+		m_nCacheMisses++;
+		return false;
+	}
+
+	/** stores a result in the cache, replacing the oldest one */
+	void storeCached( Ubitrack::Measurement::Timestamp t, unsigned long long nGeneration, const EventType& event ) const
+	{
+		boost::mutex::scoped_lock l( m_cacheMutex );
+		if ( m_cache.empty() )
+			return;
+
+		CacheEntry& rEntry( m_cache[ m_nCacheNext ] );
+		rEntry.time = t;
+		rEntry.nGeneration = nGeneration;
+		rEntry.bValid = true;
+		rEntry.event = event;
+		m_nCacheNext = ( m_nCacheNext + 1 ) % m_cache.size();
+	}
+
+	/** a cached result */
+	struct CacheEntry
+	{
+		CacheEntry()
+			: time( 0 )
+			, nGeneration( 0 )
+			, bValid( false )
+		{}
+
+		Ubitrack::Measurement::Timestamp time;
+
+		/** push generation when the result was computed */
+		unsigned long long nGeneration;
+
+		/** true if the entry holds a result */
+		bool bValid;
+
+		EventType event;
+	};
+
 	/** pointer to callback function */
 	FunctionType m_function;
+
+	/** pointer to non-throwing callback function, may be empty */
+	TryFunctionType m_tryFunction;
+
+	/** protects the cache */
+	mutable boost::mutex m_cacheMutex;
+
+	/** the component computing the results, set when the cache is enabled */
+	const Component* m_pComponent;
+
+	/** the cached results, empty if caching is disabled */
+	mutable std::vector< CacheEntry > m_cache;
+
+	/** index of the entry to be replaced next */
+	mutable std::size_t m_nCacheNext;
+
+	mutable unsigned long long m_nCacheHits;
+	mutable unsigned long long m_nCacheMisses;
 };
 
 /**
@@ -87,11 +276,18 @@ public:
 	 * @param function function to be called by clients to query measurements. Must be of type
 	 *    <tt>boost::shared_ptr< EventType >( Timestamp )</tt>. Use \c boost::bind to supply
 	 *    member functions of objects
+	 * @param tryFunction optional function that returns false instead of throwing if no measurement
+	 *    is available, see PullSupplierCore::TryFunctionType
 	 */
-	PullSupplier( const std::string& sName, Component& rParent, const typename PullSupplierCore< EventType >::FunctionType& function )
+	PullSupplier( const std::string& sName, Component& rParent, const typename PullSupplierCore< EventType >::FunctionType& function,
+		const typename PullSupplierCore< EventType >::TryFunctionType& tryFunction = typename PullSupplierCore< EventType >::TryFunctionType() )
 		: Port( sName, rParent )
-		, PullSupplierCore< EventType >( function )
+		, PullSupplierCore< EventType >( function, tryFunction )
 	{}
+
+	/** implements the Port interface */
+	void setPullCacheSize( std::size_t nEntries )
+	{ PullSupplierCore< EventType >::setCacheSize( nEntries, getComponent() ); }
 };
 
 } } // namespace Ubitrack::Dataflow
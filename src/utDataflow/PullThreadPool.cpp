@@ -0,0 +1,209 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the pull thread pool
+ */
+
+#include <cstdlib>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include "PullThreadPool.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.PullThreadPool" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+
+PullTask::PullTask( const boost::function< void () >& function )
+	: m_function( function )
+	, m_state( task_pending )
+	, m_bFailed( false )
+{}
+
+
+void PullTask::run()
+{
+	int state = task_pending;
+	if ( !m_state.compare_exchange_strong( state, task_running, boost::memory_order_acquire ) )
+		return;
+
+	try
+	{
+		m_function();
+	}
+	catch ( const Ubitrack::Util::Exception& e )
+	{
+		m_bFailed = true;
+		m_sError = e.what();
+	}
+	catch ( const std::exception& e )
+	{
+		m_bFailed = true;
+		m_sError = e.what();
+	}
+	catch ( ... )
+	{
+		m_bFailed = true;
+		m_sError = "unknown exception in asynchronous pull";
+	}
+
+	boost::mutex::scoped_lock l( m_mutex );
+	m_state.store( task_done, boost::memory_order_release );
+	m_doneCondition.notify_all();
+}
+
+
+void PullTask::join()
+{
+	// nobody started the task yet, so do it here
+	run();
+
+	if ( !isDone() )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		while ( !isDone() )
+			m_doneCondition.wait( l );
+	}
+
+	if ( m_bFailed )
+		UBITRACK_THROW( m_sError );
+}
+
+
+PullThreadPool::PullThreadPool( unsigned nThreads )
+	: m_bStop( false )
+	, m_nThreads( 0 )
+{
+	if ( nThreads == 0 )
+	{
+		const char* pThreads = std::getenv( "UBITRACK_PULL_THREADS" );
+		if ( pThreads )
+			nThreads = static_cast< unsigned >( std::max( 0, std::atoi( pThreads ) ) );
+	}
+
+	startThreads( nThreads );
+}
+
+
+PullThreadPool::~PullThreadPool()
+{
+	endThreads();
+}
+
+
+void PullThreadPool::setNumberOfThreads( unsigned nThreads )
+{
+	endThreads();
+	startThreads( nThreads );
+}
+
+
+void PullThreadPool::submit( boost::shared_ptr< PullTask > pTask )
+{
+	if ( !getNumberOfThreads() )
+		return;
+
+	boost::mutex::scoped_lock l( m_mutex );
+	m_tasks.push_back( pTask );
+	m_condition.notify_one();
+}
+
+
+void PullThreadPool::threadFunction()
+{
+	while ( true )
+	{
+		boost::shared_ptr< PullTask > pTask;
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			while ( m_tasks.empty() && !m_bStop )
+				m_condition.wait( l );
+			if ( m_bStop )
+				return;
+
+			pTask = m_tasks.front();
+			m_tasks.pop_front();
+		}
+
+		// does nothing if the joining thread was faster
+		pTask->run();
+	}
+}
+
+
+void PullThreadPool::startThreads( unsigned nThreads )
+{
+	if ( !nThreads )
+		return;
+
+	LOG4CPP_INFO( logger, "Starting " << nThreads << " pull thread(s)" );
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_bStop = false;
+	}
+
+	for ( unsigned i = 0; i < nThreads; i++ )
+		m_threads.push_back( boost::shared_ptr< boost::thread >( new boost::thread( boost::bind( &PullThreadPool::threadFunction, this ) ) ) );
+	m_nThreads.store( nThreads, boost::memory_order_relaxed );
+}
+
+
+void PullThreadPool::endThreads()
+{
+	m_nThreads.store( 0, boost::memory_order_relaxed );
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_bStop = true;
+		m_condition.notify_all();
+	}
+
+	for ( unsigned i = 0; i < m_threads.size(); i++ )
+		m_threads[ i ]->join();
+	m_threads.clear();
+
+	// remaining tasks are run by the threads joining them
+	boost::mutex::scoped_lock l( m_mutex );
+	m_tasks.clear();
+}
+
+
+PullThreadPool& PullThreadPool::singleton()
+{
+	static boost::mutex singletonMutex;
+	static boost::scoped_ptr< PullThreadPool > pPool;
+
+	boost::mutex::scoped_lock l( singletonMutex );
+	if ( !pPool )
+		pPool.reset( new PullThreadPool );
+	return *pPool;
+}
+
+
+} } // namespace Ubitrack::Dataflow
@@ -0,0 +1,199 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Thread pool for asynchronous pulls
+ */
+
+#ifndef __Ubitrack_Dataflow_PullThreadPool_INCLUDED__
+#define __Ubitrack_Dataflow_PullThreadPool_INCLUDED__
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <utDataflow.h>
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * A pull executed by the PullThreadPool.
+ *
+ * The thread waiting for the result runs the task itself if no pool thread has started it yet,
+ * so waiting never depends on free pool threads. This also allows pulls that are started by
+ * asynchronous pulls.
+ */
+class UTDATAFLOW_EXPORT PullTask
+	: private boost::noncopyable
+{
+public:
+	/** @param function the work, may throw */
+	PullTask( const boost::function< void () >& function );
+
+	/** runs the task unless another thread has started it already */
+	void run();
+
+	/**
+	 * Waits until the task is finished, running it in the calling thread if it was not started yet.
+	 * Throws a \c Ubitrack::Util::Exception if the task threw an exception.
+	 */
+	void join();
+
+	/** returns true if the task is finished */
+	bool isDone() const
+	{ return m_state.load( boost::memory_order_acquire ) == task_done; }
+
+protected:
+	/** states of a task */
+	enum { task_pending, task_running, task_done };
+
+	/** the work */
+	boost::function< void () > m_function;
+
+	/** one of the states */
+	boost::atomic< int > m_state;
+
+	/** protects m_doneCondition */
+	boost::mutex m_mutex;
+
+	/** signalled when the task is finished */
+	boost::condition_variable m_doneCondition;
+
+	/** did the task throw? */
+	bool m_bFailed;
+
+	/** the message of the exception thrown by the task */
+	std::string m_sError;
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * Result of an asynchronous pull, see PullConsumerCore::getAsync().
+ */
+template< class EventType >
+class PullFuture
+{
+public:
+	PullFuture( boost::shared_ptr< PullTask > pTask, boost::shared_ptr< EventType > pResult )
+		: m_pTask( pTask )
+		, m_pResult( pResult )
+	{}
+
+	/** waits for the pull and returns the result. Throws if the pull failed. */
+	const EventType& get() const
+	{
+		m_pTask->join();
+		return *m_pResult;
+	}
+
+	/** returns true if the result is available without waiting */
+	bool isReady() const
+	{ return m_pTask->isDone(); }
+
+protected:
+	/** the pull */
+	boost::shared_ptr< PullTask > m_pTask;
+
+	/** the result, written by the task */
+	boost::shared_ptr< EventType > m_pResult;
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * Threads that execute pulls in parallel, e.g. the independent pull inputs of a TriggerGroup.
+ *
+ * The pool has no threads by default, then tasks are executed by the thread waiting for them
+ * and pulls are sequential. The number of threads is taken from the environment variable
+ * UBITRACK_PULL_THREADS or set with setNumberOfThreads().
+ */
+class UTDATAFLOW_EXPORT PullThreadPool
+	: private boost::noncopyable
+{
+public:
+	/** @param nThreads number of threads, if 0 the number is taken from UBITRACK_PULL_THREADS */
+	PullThreadPool( unsigned nThreads = 0 );
+
+	/** stops the threads. Queued tasks are executed by the threads joining them. */
+	~PullThreadPool();
+
+	/** changes the number of threads. Must not be called while pulls are running. */
+	void setNumberOfThreads( unsigned nThreads );
+
+	/** returns the number of threads */
+	unsigned getNumberOfThreads() const
+	{ return m_nThreads.load( boost::memory_order_relaxed ); }
+
+	/**
+	 * Queues a task. The caller must join() it eventually.
+	 * Without threads, the task is left to the joining thread.
+	 */
+	void submit( boost::shared_ptr< PullTask > pTask );
+
+	/** returns the global pool */
+	static PullThreadPool& singleton();
+
+protected:
+	/** thread function */
+	void threadFunction();
+
+	/** starts threads */
+	void startThreads( unsigned nThreads );
+
+	/** stops all threads */
+	void endThreads();
+
+	/** protects the following members */
+	boost::mutex m_mutex;
+
+	/** signalled when a task is queued or the threads should end */
+	boost::condition_variable m_condition;
+
+	/** queued tasks */
+	std::deque< boost::shared_ptr< PullTask > > m_tasks;
+
+	/** tells the threads to end */
+	bool m_bStop;
+
+	/** the threads */
+	std::vector< boost::shared_ptr< boost::thread > > m_threads;
+
+	/** number of threads, read without locking */
+	boost::atomic< unsigned > m_nThreads;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
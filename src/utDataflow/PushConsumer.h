@@ -32,6 +32,7 @@
 #ifndef __Ubitrack_Dataflow_PushConsumer_INCLUDED__
 #define __Ubitrack_Dataflow_PushConsumer_INCLUDED__
 
+#include <utility>
 #include <boost/function.hpp>
 
 #include "Port.h"
@@ -40,6 +41,30 @@
 
 namespace Ubitrack { namespace Dataflow {
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+/**
+ * \internal
+ * Binds a member function that takes events by rvalue reference, as \c boost::bind cannot forward them.
+ */
+template< class Class, class EventType >
+class MemberMoveSlot
+{
+public:
+	MemberMoveSlot( void ( Class::*pMethod )( EventType&& ), Class* pObject )
+		: m_pMethod( pMethod )
+		, m_pObject( pObject )
+	{}
+
+	void operator()( EventType&& rEvent ) const
+	{ ( m_pObject->*m_pMethod )( std::move( rEvent ) ); }
+
+protected:
+	void ( Class::*m_pMethod )( EventType&& );
+	Class* m_pObject;
+};
+#endif
+
+
 /**
  * \internal
  * Implements the core functionality of a push consumer.
@@ -54,6 +79,11 @@ public:
 	/** type of pointers to functions receiving events */
 	typedef boost::function< void ( const EventType& ) > SlotType;
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/** type of pointers to functions receiving events that they may move from */
+	typedef boost::function< void ( EventType&& ) > MoveSlotType;
+#endif
+
 	/**
 	 * constructor.
 	 * @param slot the function to call when events are received
@@ -61,13 +91,29 @@ public:
 	PushConsumerCore( Port& rPort, const SlotType& slot, EventQueue::ReceiverInfo::MutexType* pMutex = 0 )
 		: m_slot( slot )
 		, m_rPort( rPort )
-		, m_receiverInfo( &rPort, pMutex, EventTypeTraits< EventType >().getMaxQueueLength() )
-	{}
+		, m_receiverInfo( &rPort, pMutex, EventTypeTraits< EventType >().getMaxQueueLength(), EventQueue::overflow_drop_oldest,
+			EventTypeTraits< EventType >().getMaxAge() )
+	{
+		rPort.addReceiverInfo( &m_receiverInfo );
+	}
 
 	/** returns the function to be called by the supplier */
 	SlotType& getSlot()
 	{ return m_slot; }
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/**
+	 * Sets a function that is called instead of the slot when this consumer is the only
+	 * receiver of an event. The event can then be moved into the consumer without a copy.
+	 */
+	void setMoveSlot( const MoveSlotType& slot )
+	{ m_moveSlot = slot; }
+
+	/** returns the function receiving events that may be moved from, empty if not set */
+	MoveSlotType& getMoveSlot()
+	{ return m_moveSlot; }
+#endif
+
 	/** returns the port this thing belongs to */
 	Port& getPort()
 	{ return m_rPort; }
@@ -84,6 +130,11 @@ private:
 	/** function to be called by the supplier */
 	SlotType m_slot;
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/** function to be called by the supplier with events that may be moved from */
+	MoveSlotType m_moveSlot;
+#endif
+
 	/** reference to parent component */
 	Port& m_rPort;
 
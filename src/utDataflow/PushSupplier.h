@@ -33,9 +33,14 @@
 #define __Ubitrack_Dataflow_PushSupplier_INCLUDED__
 
 #include <list>
+#include <utility>
 #include <algorithm>
 #include <typeinfo>
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <utUtil/Exception.h>
 
 
@@ -48,6 +53,171 @@
 namespace Ubitrack { namespace Dataflow {
 
 
+/**
+ * @ingroup dataflow_framework
+ * Result of sending an event through a push supplier.
+ * It describes the queues of the consumers at the time the event was sent, before it was queued.
+ */
+enum SendStatus
+{
+	/** the event was delivered or queued for all consumers */
+	send_ok,
+
+	/** 
+	 * at least one consumer was saturated (see EventQueue::ReceiverInfo::isSaturated()), so its 
+	 * overflow policy applies to the event: it or an older one is dropped or conflated, or the sender
+	 * was blocked. If the consumer dispatched events while the event was being queued, the policy
+	 * may not have been needed after all.
+	 */
+	send_saturated,
+
+	/** no consumer is connected, the event was discarded */
+	send_unconnected
+};
+
+
+/**
+ * \internal
+ * Payload of the events queued for a push consumer: calls the consumer with its own copy of the event.
+ *
+ * @param EventType type of measurements to be pushed
+ */
+template< class EventType >
+struct PushEvent
+{
+	/**
+	 * @param rConsumer the receiver
+	 * @param rEvent the event
+	 * @param bOnlyReceiver true if no other consumer receives the event, so the consumer's move slot may be used
+	 */
+	PushEvent( PushConsumerCore< EventType >& rConsumer, const EventType& rEvent, bool bOnlyReceiver = false )
+		: pConsumer( &rConsumer )
+		, bMovable( bOnlyReceiver )
+		, event( rEvent )
+	{}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	PushEvent( PushConsumerCore< EventType >& rConsumer, EventType&& rEvent, bool bOnlyReceiver = false )
+		: pConsumer( &rConsumer )
+		, bMovable( bOnlyReceiver )
+		, event( std::move( rEvent ) )
+	{}
+#endif
+
+	/** delivers the event */
+	void operator()()
+	{
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+		// the event is not used after delivery, so the only consumer may take it over
+		if ( bMovable && pConsumer->getMoveSlot() )
+		{
+			pConsumer->getMoveSlot()( std::move( event ) );
+			return;
+		}
+#endif
+		pConsumer->getSlot()( event );
+	}
+
+	/** the consumer, which is valid as long as it has events in the queue */
+	PushConsumerCore< EventType >* pConsumer;
+
+	/** true if the consumer is the only receiver, see PushConsumerCore::setMoveSlot() */
+	bool bMovable;
+
+	/** the event */
+	EventType event;
+};
+
+
+/**
+ * \internal
+ * Payload of events queued for several push consumers: all consumers receive the same const copy of the event.
+ * Only used for event types with deep copies, see EventSharesPayload.
+ *
+ * @param EventType type of measurements to be pushed
+ */
+template< class EventType >
+struct SharedPushEvent
+{
+	/** type of the consumer's slot */
+	typedef typename PushConsumerCore< EventType >::SlotType SlotType;
+
+	SharedPushEvent( const SlotType& slot, const boost::shared_ptr< const EventType >& _pEvent )
+		: pSlot( &slot )
+		, pEvent( _pEvent )
+	{}
+
+	/** delivers the event */
+	void operator()()
+	{ ( *pSlot )( *pEvent ); }
+
+	/** the slot of the consumer, which is valid as long as the consumer has events in the queue */
+	const SlotType* pSlot;
+
+	/** the shared event, only accessible as const */
+	boost::shared_ptr< const EventType > pEvent;
+};
+
+
+/**
+ * \internal
+ * Delivers an event directly to a single push consumer without copying it, see EventQueue::dispatchDirect().
+ *
+ * @param EventType type of measurements to be pushed
+ */
+template< class EventType >
+struct DirectPushEvent
+{
+	DirectPushEvent( PushConsumerCore< EventType >& rConsumer, const EventType& rEvent )
+		: pConsumer( &rConsumer )
+		, pEvent( &rEvent )
+	{}
+
+	/** delivers the event */
+	void operator()()
+	{ pConsumer->getSlot()( *pEvent ); }
+
+	/** the consumer */
+	PushConsumerCore< EventType >* pConsumer;
+
+	/** the event, owned by the caller of send() */
+	const EventType* pEvent;
+};
+
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+/**
+ * \internal
+ * Delivers an event directly to a single push consumer, which may move from it.
+ *
+ * @param EventType type of measurements to be pushed
+ */
+template< class EventType >
+struct DirectMovePushEvent
+{
+	DirectMovePushEvent( PushConsumerCore< EventType >& rConsumer, EventType& rEvent )
+		: pConsumer( &rConsumer )
+		, pEvent( &rEvent )
+	{}
+
+	/** delivers the event */
+	void operator()()
+	{
+		if ( pConsumer->getMoveSlot() )
+			pConsumer->getMoveSlot()( std::move( *pEvent ) );
+		else
+			pConsumer->getSlot()( *pEvent );
+	}
+
+	/** the consumer */
+	PushConsumerCore< EventType >* pConsumer;
+
+	/** the event, passed as rvalue to send() */
+	EventType* pEvent;
+};
+#endif
+
+
 /**
  * \internal
  * Implements the core functionality of a push supplier.
@@ -59,13 +229,84 @@ template< class EventType >
 class PushSupplierCore
 {
 public:
+	/** constructor */
+	PushSupplierCore()
+		: m_bDirectDispatch( false )
+		, m_bSendHook( false )
+		, m_nSharedSends( 0 )
+		, m_nCopiedSends( 0 )
+		, m_nMovedSends( 0 )
+	{}
+
 	/**
 	 * Send events to the connected PushConsumers.
-	 * Events are not sent directly, but stored in a queue to prevent deep recursions.
+	 * Events are not sent directly, but stored in a queue to prevent deep recursions,
+	 * unless direct dispatch is enabled, see setDirectDispatch().
+	 * If more than one consumer is connected and copies of the event are deep, a single copy is 
+	 * shared by all of them. Measurements already share their payload, so each consumer gets its own
+	 * shallow copy, see EventSharesPayload. Consumers can therefore modify the payload of a 
+	 * measurement that other consumers receive as well, and must not do so.
 	 *
 	 * @param rEvent Measurement to be sent
+	 * @return the state of the consumers' queues before the event was queued, see SendStatus
+	 */
+	SendStatus send( const EventType& rEvent );
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/**
+	 * Send events to the connected PushConsumers, moving the event into the queue.
+	 * With a single consumer, the event is not copied at all.
+	 *
+	 * @param rEvent Measurement to be sent
+	 * @return the state of the consumers' queues before the event was queued, see SendStatus
+	 */
+	SendStatus send( EventType&& rEvent );
+#endif
+
+	/** returns the number of sends that shared one deep copy of the event between several consumers */
+	unsigned long long getSharedSends() const
+	{ return m_nSharedSends.load( boost::memory_order_relaxed ); }
+
+	/** returns the number of sends that queued a copy of the event for each consumer */
+	unsigned long long getCopiedSends() const
+	{ return m_nCopiedSends.load( boost::memory_order_relaxed ); }
+
+	/** returns the number of sends that moved the event into the queue of the only consumer */
+	unsigned long long getMovedSends() const
+	{ return m_nMovedSends.load( boost::memory_order_relaxed ); }
+
+	/**
+	 * Enables direct dispatch. If only one consumer is connected, send() then calls it directly
+	 * when possible, instead of queueing the event. Otherwise, the event is queued as usual.
+	 * See EventQueue::dispatchDirect() for the conditions and the ordering guarantees.
+	 */
+	void setDirectDispatch( bool bDirect )
+	{ m_bDirectDispatch = bDirect; }
+
+	/** returns true if direct dispatch is enabled */
+	bool getDirectDispatch() const
+	{ return m_bDirectDispatch; }
+
+	/** type of functions that observe sent events */
+	typedef boost::function< void ( const EventType& ) > SendHookType;
+
+	/**
+	 * Sets a function that is called with every event before it is sent, e.g. to record the events
+	 * of a source, see EventRecorder. An empty function removes the hook.
+	 *
+	 * May be called while other threads send events. Sends that are already running may still call
+	 * the previous hook after this returns.
 	 */
-	void send( const EventType& rEvent );
+	void setSendHook( const SendHookType& hook );
+
+	/**
+	 * Returns true if all connected consumers are saturated, so that an event sent now would only be 
+	 * dropped or replace an older one, or block the sender, depending on the overflow policies.
+	 * Consumers with the conflate policy are saturated as soon as they have an event pending.
+	 * Sources with expensive processing, such as image decoding, can use this to skip events that
+	 * nobody can consume. Consumers with unlimited queues are never saturated.
+	 */
+	bool isSaturated() const;
 
 	/**
 	 * returns true if at least one consumer is connected
@@ -87,12 +328,52 @@ protected:
 	template< class OtherSide >
 	void removePushConsumer( OtherSide& rConsumer );
 
+	/** calls the send hook, if any */
+	void callSendHook( const EventType& rEvent ) const
+	{
+		if ( !m_bSendHook.load( boost::memory_order_acquire ) )
+			return;
+
+		boost::shared_ptr< const SendHookType > pHook( boost::atomic_load( &m_pSendHook ) );
+		if ( pHook )
+			( *pHook )( rEvent );
+	}
+
+	/** returns the status of a send in the current state of the consumers' queues, called before queueing */
+	SendStatus consumerStatus() const;
+
+	/** queues an event for the only consumer */
+	void sendSingle( PushEvent< EventType >& payload, unsigned long long priority );
+
+	/** queues a copy of an event for each consumer */
+	void sendCopies( const EventType& rEvent, unsigned long long priority );
+
+	/** queues events for all consumers sharing one copy of the event */
+	void sendShared( const boost::shared_ptr< const EventType >& pShared, unsigned long long priority );
+
 	/** type shortcut for list of consumers */
 	typedef std::list< PushConsumerCore< EventType >* > ConsumerList;
 
 	/** the list of consumers */
 	ConsumerList m_pushConsumers;
 
+	/** try to call the consumer directly */
+	bool m_bDirectDispatch;
+
+	/** called with every sent event, may be 0. Replaced atomically, never modified. */
+	boost::shared_ptr< const SendHookType > m_pSendHook;
+
+	/** true if m_pSendHook may be set, so sends without hook do not need to load it */
+	boost::atomic< bool > m_bSendHook;
+
+	/** number of sends with a shared copy of the event */
+	boost::atomic< unsigned long long > m_nSharedSends;
+
+	/** number of sends with a copy of the event */
+	boost::atomic< unsigned long long > m_nCopiedSends;
+
+	/** number of sends that moved the event */
+	boost::atomic< unsigned long long > m_nMovedSends;
 };
 
 
@@ -124,22 +405,195 @@ void PushSupplierCore< EventType >::removePushConsumer( OtherSide& rConsumer )
 
 
 template< class EventType >
-void PushSupplierCore< EventType >::send( const EventType& rEvent )
+void PushSupplierCore< EventType >::setSendHook( const SendHookType& hook )
+{
+	// the flag is set after a hook is stored and cleared before it is removed, so it is never false while a hook is set
+	if ( hook )
+	{
+		boost::atomic_store( &m_pSendHook, boost::shared_ptr< const SendHookType >( new SendHookType( hook ) ) );
+		m_bSendHook.store( true, boost::memory_order_release );
+	}
+	else
+	{
+		m_bSendHook.store( false, boost::memory_order_release );
+		boost::atomic_store( &m_pSendHook, boost::shared_ptr< const SendHookType >() );
+	}
+}
+
+
+template< class EventType >
+bool PushSupplierCore< EventType >::isSaturated() const
+{
+	if ( m_pushConsumers.empty() )
+		return false;
+
+	for ( typename ConsumerList::const_iterator it = m_pushConsumers.begin(); it != m_pushConsumers.end(); it++ )
+		if ( !(*it)->getReceiverInfo().isSaturated() )
+			return false;
+
+	return true;
+}
+
+
+template< class EventType >
+SendStatus PushSupplierCore< EventType >::consumerStatus() const
+{
+	if ( m_pushConsumers.empty() )
+		return send_unconnected;
+
+	for ( typename ConsumerList::const_iterator it = m_pushConsumers.begin(); it != m_pushConsumers.end(); it++ )
+		if ( (*it)->getReceiverInfo().isSaturated() )
+			return send_saturated;
+
+	return send_ok;
+}
+
+
+template< class EventType >
+SendStatus PushSupplierCore< EventType >::send( const EventType& rEvent )
+{
+	// the timestamp and the event priority of the receiving component are passed separately,
+	// the event queue orders by (timestamp, rank)
+	callSendHook( rEvent );
+
+	const unsigned long long priority( EventTypeTraits< EventType >().getPriority( rEvent ) );
+	const SendStatus status( consumerStatus() );
+
+	if ( m_pushConsumers.size() == 1 )
+	{
+		// a single consumer may be called directly without copying the event
+		PushConsumerCore< EventType >& rConsumer( *m_pushConsumers.front() );
+		DirectPushEvent< EventType > direct( rConsumer, rEvent );
+		if ( m_bDirectDispatch && rConsumer.getPort().getEventQueue().dispatchDirect( rConsumer.getReceiverInfo(), direct ) )
+			return status;
+
+		// otherwise it gets its own copy
+		PushEvent< EventType > payload( *m_pushConsumers.front(), rEvent, true );
+		sendSingle( payload, priority );
+		m_nCopiedSends.fetch_add( 1, boost::memory_order_relaxed );
+	}
+	else if ( m_pushConsumers.empty() )
+		return status;
+	else if ( EventSharesPayload< EventType >::value )
+		// copies are cheap
+		sendCopies( rEvent, priority );
+	else
+		// copy the event only once for all consumers
+		sendShared( boost::make_shared< EventType >( rEvent ), priority );
+
+	return status;
+}
+
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+template< class EventType >
+SendStatus PushSupplierCore< EventType >::send( EventType&& rEvent )
+{
+	callSendHook( rEvent );
+
+	const unsigned long long priority( EventTypeTraits< EventType >().getPriority( rEvent ) );
+	const SendStatus status( consumerStatus() );
+
+	if ( m_pushConsumers.size() == 1 )
+	{
+		PushConsumerCore< EventType >& rConsumer( *m_pushConsumers.front() );
+		DirectMovePushEvent< EventType > direct( rConsumer, rEvent );
+		if ( m_bDirectDispatch && rConsumer.getPort().getEventQueue().dispatchDirect( rConsumer.getReceiverInfo(), direct ) )
+			return status;
+
+		PushEvent< EventType > payload( rConsumer, std::move( rEvent ), true );
+		sendSingle( payload, priority );
+		m_nMovedSends.fetch_add( 1, boost::memory_order_relaxed );
+	}
+	else if ( m_pushConsumers.empty() )
+		return status;
+	else if ( EventSharesPayload< EventType >::value )
+		sendCopies( rEvent, priority );
+	else
+		sendShared( boost::make_shared< EventType >( std::move( rEvent ) ), priority );
+
+	return status;
+}
+#endif
+
+
+template< class EventType >
+void PushSupplierCore< EventType >::sendSingle( PushEvent< EventType >& payload, unsigned long long priority )
 {
-	// here I am lazy and just assume that timestamps are so fine-grained that I can add the 
-	// priority to the timestamp without disturbing the time order...
+	PushConsumerCore< EventType >* pConsumer( payload.pConsumer );
+	EventQueue& rQueue( pConsumer->getPort().getEventQueue() );
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	EventQueue::EventRecord* pEvent = rQueue.createEvent( &pConsumer->getReceiverInfo(), std::move( payload ),
+		priority, pConsumer->getPort().getComponent().getEventPriority() );
+#else
+	EventQueue::EventRecord* pEvent = rQueue.createEvent( &pConsumer->getReceiverInfo(), payload,
+		priority, pConsumer->getPort().getComponent().getEventPriority() );
+#endif
+
+	rQueue.queue( pEvent );
+}
+
+
+template< class EventType >
+void PushSupplierCore< EventType >::sendCopies( const EventType& rEvent, unsigned long long priority )
+{
+	// create a chain of events, one for each consumer
+	EventQueue* pQueue( &m_pushConsumers.front()->getPort().getEventQueue() );
+	EventQueue::EventRecord* pEvents = 0;
+	EventQueue::EventRecord** ppLast = &pEvents;
+	for ( typename ConsumerList::iterator it = m_pushConsumers.begin(); it != m_pushConsumers.end(); it++ ) {
 
-	// create list of events for each consumer
-	std::vector< EventQueue::QueueData > events;
+		// consumers in the same network share a queue, otherwise queue what we have so far
+		EventQueue* pConsumerQueue( &(*it)->getPort().getEventQueue() );
+		if ( pConsumerQueue != pQueue )
+		{
+			pQueue->queue( pEvents );
+			pQueue = pConsumerQueue;
+			pEvents = 0;
+			ppLast = &pEvents;
+		}
+		
+		*ppLast = pQueue->createEvent( &(*it)->getReceiverInfo(), PushEvent< EventType >( **it, rEvent ),
+			priority, (*it)->getPort().getComponent().getEventPriority() );
+		ppLast = &(*ppLast)->pNext;
+			
+	}
+	m_nCopiedSends.fetch_add( 1, boost::memory_order_relaxed );
+	
+	// enqueue it all in one go
+	pQueue->queue( pEvents );
+}
+
+
+template< class EventType >
+void PushSupplierCore< EventType >::sendShared( const boost::shared_ptr< const EventType >& pShared, unsigned long long priority )
+{
+	// create a chain of events, one for each consumer
+	EventQueue* pQueue( &m_pushConsumers.front()->getPort().getEventQueue() );
+	EventQueue::EventRecord* pEvents = 0;
+	EventQueue::EventRecord** ppLast = &pEvents;
 	for ( typename ConsumerList::iterator it = m_pushConsumers.begin(); it != m_pushConsumers.end(); it++ ) {
+
+		// consumers in the same network share a queue, otherwise queue what we have so far
+		EventQueue* pConsumerQueue( &(*it)->getPort().getEventQueue() );
+		if ( pConsumerQueue != pQueue )
+		{
+			pQueue->queue( pEvents );
+			pQueue = pConsumerQueue;
+			pEvents = 0;
+			ppLast = &pEvents;
+		}
 		
-		events.push_back( EventQueue::QueueData( &(*it)->getReceiverInfo(), boost::bind( (*it)->getSlot(), EventType( rEvent ) ),
-			EventTypeTraits< EventType >().getPriority( rEvent ) + (*it)->getPort().getComponent().getEventPriority() ) );		
+		*ppLast = pQueue->createEvent( &(*it)->getReceiverInfo(), SharedPushEvent< EventType >( (*it)->getSlot(), pShared ),
+			priority, (*it)->getPort().getComponent().getEventPriority() );
+		ppLast = &(*ppLast)->pNext;
 			
 	}
+	m_nSharedSends.fetch_add( 1, boost::memory_order_relaxed );
 	
 	// enqueue it all in one go
-	EventQueue::singleton().queue( events );
+	pQueue->queue( pEvents );
 }
 
 
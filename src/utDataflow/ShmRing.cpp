@@ -0,0 +1,191 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the shared memory ring buffer
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include "ShmRing.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.ShmRing" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+namespace bi = boost::interprocess;
+
+/** \internal slots are aligned to 16 bytes */
+static std::size_t slotStride( std::size_t nSlotSize )
+{ return ( sizeof( ShmRing::SlotHeader ) + nSlotSize + 15 ) & ~std::size_t( 15 ); }
+
+/** \internal how long to wait for another process initializing the segment, in milliseconds */
+static const int g_initTimeout = 1000;
+
+
+ShmRing::ShmRing( const std::string& sName, std::size_t nSlots, std::size_t nSlotSize )
+	: m_sName( sName )
+	, m_pHeader( 0 )
+	, m_pSlots( 0 )
+	, m_nSlotStride( slotStride( nSlotSize ) )
+{
+	boost::uint32_t nRoundedSlots = 1;
+	while ( nRoundedSlots < nSlots )
+		nRoundedSlots <<= 1;
+	const std::size_t nTotalSize( sizeof( Header ) + nRoundedSlots * m_nSlotStride );
+
+	bool bCreated = false;
+	try
+	{
+		try
+		{
+			m_pSegment.reset( new bi::shared_memory_object( bi::create_only, sName.c_str(), bi::read_write ) );
+			bCreated = true;
+			m_pSegment->truncate( nTotalSize );
+		}
+		catch ( const bi::interprocess_exception& e )
+		{
+			if ( bCreated || e.get_error_code() != bi::already_exists_error )
+				throw;
+
+			m_pSegment.reset( new bi::shared_memory_object( bi::open_only, sName.c_str(), bi::read_write ) );
+
+			// the creating process may not have set the size yet
+			bi::offset_t nSize = 0;
+			for ( int i = 0; i < g_initTimeout && ( !m_pSegment->get_size( nSize ) || nSize < bi::offset_t( sizeof( Header ) ) ); i++ )
+				boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+			if ( nSize < bi::offset_t( sizeof( Header ) ) )
+				UBITRACK_THROW( "Shared memory " + sName + " was not initialized, remove it" );
+		}
+
+		m_pRegion.reset( new bi::mapped_region( *m_pSegment, bi::read_write ) );
+	}
+	catch ( const bi::interprocess_exception& e )
+	{
+		UBITRACK_THROW( "Cannot open shared memory " + sName + ": " + e.what() );
+	}
+
+	if ( bCreated )
+	{
+		m_pHeader = new ( m_pRegion->get_address() ) Header;
+		std::memcpy( m_pHeader->magic, "UTSHMRG1", sizeof( m_pHeader->magic ) );
+		m_pHeader->nSlots = nRoundedSlots;
+		m_pHeader->nSlotSize = static_cast< boost::uint32_t >( nSlotSize );
+		m_pHeader->nWritten.store( 0, boost::memory_order_relaxed );
+		m_pHeader->nDropped.store( 0, boost::memory_order_relaxed );
+		m_pHeader->nRead.store( 0, boost::memory_order_relaxed );
+		m_pHeader->nInitialized.store( 1, boost::memory_order_release );
+		LOG4CPP_INFO( logger, "Created shared memory " << sName << ": " << nRoundedSlots << " slots of " << nSlotSize << " bytes" );
+	}
+	else
+	{
+		m_pHeader = static_cast< Header* >( m_pRegion->get_address() );
+		for ( int i = 0; i < g_initTimeout && !m_pHeader->nInitialized.load( boost::memory_order_acquire ); i++ )
+			boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+
+		if ( !m_pHeader->nInitialized.load( boost::memory_order_acquire ) || std::memcmp( m_pHeader->magic, "UTSHMRG1", sizeof( m_pHeader->magic ) ) )
+			UBITRACK_THROW( "Shared memory " + sName + " is not an event ring, remove it" );
+		if ( m_pHeader->nSlots != nRoundedSlots || m_pHeader->nSlotSize != nSlotSize || m_pRegion->get_size() < nTotalSize )
+			UBITRACK_THROW( "Shared memory " + sName + " has a different number or size of slots, remove it" );
+		LOG4CPP_INFO( logger, "Opened shared memory " << sName );
+	}
+
+	if ( !m_pHeader->nWritten.is_lock_free() )
+		UBITRACK_THROW( "Shared memory rings need lock-free atomic integers" );
+
+	m_pSlots = static_cast< char* >( m_pRegion->get_address() ) + sizeof( Header );
+}
+
+
+ShmRing::~ShmRing()
+{
+	if ( m_pHeader && m_pHeader->nDropped.load( boost::memory_order_relaxed ) )
+		LOG4CPP_INFO( logger, "Shared memory " << m_sName << ": " << getDroppedCount() << " events dropped" );
+}
+
+
+char* ShmRing::beginWrite()
+{
+	const boost::uint32_t nWritten( m_pHeader->nWritten.load( boost::memory_order_relaxed ) );
+	if ( nWritten - m_pHeader->nRead.load( boost::memory_order_acquire ) >= m_pHeader->nSlots )
+	{
+		m_pHeader->nDropped.fetch_add( 1, boost::memory_order_relaxed );
+		return 0;
+	}
+
+	return reinterpret_cast< char* >( slot( nWritten ) + 1 );
+}
+
+
+void ShmRing::endWrite( std::size_t nSize, unsigned long long priority )
+{
+	const boost::uint32_t nWritten( m_pHeader->nWritten.load( boost::memory_order_relaxed ) );
+	SlotHeader* pSlot( slot( nWritten ) );
+	pSlot->nSize = static_cast< boost::uint32_t >( std::min< std::size_t >( nSize, m_pHeader->nSlotSize ) );
+	pSlot->priority = priority;
+
+	// makes the slot visible to the reader
+	m_pHeader->nWritten.store( nWritten + 1, boost::memory_order_release );
+}
+
+
+const char* ShmRing::beginRead( std::size_t& nSize, unsigned long long& priority )
+{
+	const boost::uint32_t nRead( m_pHeader->nRead.load( boost::memory_order_relaxed ) );
+	if ( nRead == m_pHeader->nWritten.load( boost::memory_order_acquire ) )
+		return 0;
+
+	const SlotHeader* pSlot( slot( nRead ) );
+	nSize = std::min< std::size_t >( pSlot->nSize, m_pHeader->nSlotSize );
+	priority = pSlot->priority;
+	return reinterpret_cast< const char* >( pSlot + 1 );
+}
+
+
+void ShmRing::endRead()
+{
+	// makes the slot available to the writer
+	m_pHeader->nRead.store( m_pHeader->nRead.load( boost::memory_order_relaxed ) + 1, boost::memory_order_release );
+}
+
+
+void ShmRing::discardPending()
+{
+	m_pHeader->nRead.store( m_pHeader->nWritten.load( boost::memory_order_acquire ), boost::memory_order_release );
+}
+
+
+void ShmRing::remove( const std::string& sName )
+{
+	bi::shared_memory_object::remove( sName.c_str() );
+}
+
+
+} } // namespace Ubitrack::Dataflow
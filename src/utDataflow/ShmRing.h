@@ -0,0 +1,194 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Ring buffer in shared memory for passing events between processes
+ */
+
+#ifndef __Ubitrack_Dataflow_ShmRing_INCLUDED__
+#define __Ubitrack_Dataflow_ShmRing_INCLUDED__
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <utDataflow.h>
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * A ring of fixed-size slots in a named shared memory segment, written by one process and read
+ * by another.
+ *
+ * The ring is lock-free for exactly one writer and one reader: each side only advances its own
+ * counter. A full ring drops new events instead of blocking the writer. A reader that crashes
+ * therefore never stalls the writing process. Events are written and read in place, see
+ * beginWrite() and beginRead().
+ *
+ * Whichever side comes first creates the segment, the other one opens it. The segment is not
+ * removed when the ring is destroyed, so either process can be restarted. Use remove() to delete
+ * it, e.g. when the slot size is changed.
+ */
+class UTDATAFLOW_EXPORT ShmRing
+	: private boost::noncopyable
+{
+public:
+	/** header at the start of the segment. The counters are in separate cache lines. */
+	struct Header
+	{
+		/** "UTSHMRG1" */
+		char magic[ 8 ];
+
+		/** number of slots, a power of two */
+		boost::uint32_t nSlots;
+
+		/** maximum size of the data in a slot */
+		boost::uint32_t nSlotSize;
+
+		/** set to 1 when the header is initialized */
+		boost::atomic< boost::uint32_t > nInitialized;
+
+		char padding0[ 44 ];
+
+		/** number of written events, only changed by the writer */
+		boost::atomic< boost::uint32_t > nWritten;
+
+		/** number of events dropped because the ring was full, only changed by the writer */
+		boost::atomic< boost::uint32_t > nDropped;
+
+		char padding1[ 56 ];
+
+		/** number of read events, only changed by the reader */
+		boost::atomic< boost::uint32_t > nRead;
+
+		char padding2[ 60 ];
+	};
+
+	/** header of each slot, followed by the data */
+	struct SlotHeader
+	{
+		/** size of the data */
+		boost::uint32_t nSize;
+
+		boost::uint32_t reserved;
+
+		/** priority of the event, usually the measurement timestamp */
+		boost::uint64_t priority;
+	};
+
+	/**
+	 * Creates or opens a ring.
+	 * Throws a \c Ubitrack::Util::Exception if an existing ring has a different layout.
+	 *
+	 * @param sName name of the shared memory segment
+	 * @param nSlots number of slots, rounded up to a power of two
+	 * @param nSlotSize maximum size of an event in bytes
+	 */
+	ShmRing( const std::string& sName, std::size_t nSlots, std::size_t nSlotSize );
+
+	~ShmRing();
+
+	/** returns the name of the shared memory segment */
+	const std::string& getName() const
+	{ return m_sName; }
+
+	/** returns the maximum size of an event in bytes */
+	std::size_t getSlotSize() const
+	{ return m_pHeader->nSlotSize; }
+
+	/** returns the number of slots */
+	std::size_t getSlotCount() const
+	{ return m_pHeader->nSlots; }
+
+	/** returns the number of events dropped by the writer because the ring was full */
+	unsigned long getDroppedCount() const
+	{ return m_pHeader->nDropped.load( boost::memory_order_relaxed ); }
+
+	/**
+	 * Writer: returns the data of the next free slot, to be filled with at most getSlotSize()
+	 * bytes and published with endWrite(). Returns 0 and counts a dropped event if the ring is full.
+	 */
+	char* beginWrite();
+
+	/**
+	 * Writer: publishes the slot returned by beginWrite().
+	 * Not calling it discards the slot.
+	 *
+	 * @param nSize size of the data
+	 * @param priority priority of the event
+	 */
+	void endWrite( std::size_t nSize, unsigned long long priority );
+
+	/**
+	 * Reader: returns the data of the oldest unread event, or 0 if there is none.
+	 * The data stays valid until endRead() is called.
+	 *
+	 * @param nSize receives the size of the data
+	 * @param priority receives the priority of the event
+	 */
+	const char* beginRead( std::size_t& nSize, unsigned long long& priority );
+
+	/** Reader: releases the slot returned by beginRead() */
+	void endRead();
+
+	/** Reader: skips all unread events, e.g. those written while the reader was not running */
+	void discardPending();
+
+	/** removes a shared memory segment. Processes that have it mapped can still use it. */
+	static void remove( const std::string& sName );
+
+protected:
+	/** returns the header of a slot */
+	SlotHeader* slot( boost::uint32_t nIndex ) const
+	{ return reinterpret_cast< SlotHeader* >( m_pSlots + ( nIndex & ( m_pHeader->nSlots - 1 ) ) * m_nSlotStride ); }
+
+	/** name of the segment */
+	std::string m_sName;
+
+	/** the shared memory segment */
+	boost::scoped_ptr< boost::interprocess::shared_memory_object > m_pSegment;
+
+	/** the mapped segment */
+	boost::scoped_ptr< boost::interprocess::mapped_region > m_pRegion;
+
+	/** the header in the mapped segment */
+	Header* m_pHeader;
+
+	/** the first slot in the mapped segment */
+	char* m_pSlots;
+
+	/** distance of two slots in bytes */
+	std::size_t m_nSlotStride;
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
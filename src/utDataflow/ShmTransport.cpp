@@ -0,0 +1,93 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Implementation of the shared memory transport
+ */
+
+#include <boost/thread/mutex.hpp>
+#include <log4cpp/Category.hh>
+#include <utUtil/Exception.h>
+#include "ShmTransport.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Dataflow.ShmTransport" ) );
+
+namespace Ubitrack { namespace Dataflow {
+
+
+void ShmTransportComponent::start()
+{
+	Component::start();
+	m_pEndpoint->start();
+}
+
+
+void ShmTransportComponent::stop()
+{
+	m_pEndpoint->stop();
+	Component::stop();
+}
+
+
+/** \internal protects the registered event types */
+static boost::mutex g_eventTypeMutex;
+
+
+ShmTransport::EventTypeMap& ShmTransport::getEventTypes()
+{
+	static EventTypeMap eventTypes;
+	return eventTypes;
+}
+
+
+void ShmTransport::addEventType( const std::string& sTypeName, boost::shared_ptr< EventTypeBase > pType )
+{
+	boost::mutex::scoped_lock l( g_eventTypeMutex );
+	EventTypeMap& eventTypes( getEventTypes() );
+	if ( eventTypes.find( sTypeName ) == eventTypes.end() )
+	{
+		LOG4CPP_DEBUG( logger, "Registering event type " << sTypeName );
+		eventTypes[ sTypeName ] = pType;
+	}
+}
+
+
+ShmEndpoint* ShmTransport::createEndpoint( Port& rLocalPort, bool bSend, const std::string& sName, Component& rParent, const Channel& channel )
+{
+	boost::mutex::scoped_lock l( g_eventTypeMutex );
+	EventTypeMap& eventTypes( getEventTypes() );
+	for ( EventTypeMap::iterator it = eventTypes.begin(); it != eventTypes.end(); it++ )
+		if ( ShmEndpoint* pEndpoint = it->second->create( rLocalPort, bSend, sName, rParent, channel ) )
+		{
+			LOG4CPP_INFO( logger, rLocalPort.fullName() << ( bSend ? " sends to " : " receives from " ) << channel.sName );
+			return pEndpoint;
+		}
+
+	UBITRACK_THROW( "Event type of " + rLocalPort.fullName() + " is not registered for shared memory connections" );
+}
+
+
+} } // namespace Ubitrack::Dataflow
@@ -0,0 +1,554 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Ports that pass pushed events to other processes through shared memory
+ */
+
+#ifndef __Ubitrack_Dataflow_ShmTransport_INCLUDED__
+#define __Ubitrack_Dataflow_ShmTransport_INCLUDED__
+
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <typeinfo>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/type_traits/has_trivial_copy.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <log4cpp/Category.hh>
+#include <utDataflow.h>
+#include <utMeasurement/Measurement.h>
+#include "Component.h"
+#include "PushSupplier.h"
+#include "PushConsumer.h"
+#include "EventTypeTraits.h"
+#include "ShmRing.h"
+
+namespace Ubitrack { namespace Dataflow {
+
+
+/**
+ * @ingroup dataflow_framework
+ * Tells if the payload of measurements can be copied bytewise into shared memory.
+ * Specialize it for payload types that can, but are not detected.
+ */
+template< class T >
+struct ShmIsBitwiseCopyable
+{
+	static const bool value = boost::has_trivial_copy< T >::value && boost::has_trivial_destructor< T >::value;
+};
+
+
+/**
+ * \internal
+ * Writes events into shared memory slots and reads them back using boost::serialization binary
+ * archives, like the EventRecorder.
+ */
+template< class EventType >
+struct ShmSerializingCodec
+{
+	/** writes an event into a slot, returns false if it does not fit */
+	static bool write( const EventType& rEvent, char* pData, std::size_t nCapacity, std::size_t& nSize, unsigned long long& priority )
+	{
+		std::ostringstream stream;
+		{
+			boost::archive::binary_oarchive archive( stream, boost::archive::no_header );
+			archive << rEvent;
+		}
+
+		const std::string& data( stream.str() );
+		if ( data.size() > nCapacity )
+			return false;
+
+		std::memcpy( pData, data.data(), data.size() );
+		nSize = data.size();
+		priority = EventTypeTraits< EventType >().getPriority( rEvent );
+		return true;
+	}
+
+	/** reads an event from a slot */
+	static void read( const char* pData, std::size_t nSize, unsigned long long, EventType& rEvent )
+	{
+		std::istringstream stream( std::string( pData, nSize ) );
+		boost::archive::binary_iarchive archive( stream, boost::archive::no_header );
+		archive >> rEvent;
+	}
+};
+
+
+/** \internal codec of measurements, serializing by default */
+template< class T, bool bBitwise >
+struct ShmMeasurementCodec
+	: public ShmSerializingCodec< Measurement::Measurement< T > >
+{};
+
+
+/**
+ * \internal
+ * Copies the payload of measurements directly into and out of the slot. The timestamp is passed
+ * as priority, empty measurements have no data.
+ *
+ * Each side copies the payload once, and reading allocates one payload with its reference count.
+ * Measurements do not point into the slot, as consumers may keep them, e.g. in a HistoryInPort,
+ * and the slot could not be reused before.
+ */
+template< class T >
+struct ShmMeasurementCodec< T, true >
+{
+	static bool write( const Measurement::Measurement< T >& rEvent, char* pData, std::size_t nCapacity, std::size_t& nSize, unsigned long long& priority )
+	{
+		if ( sizeof( T ) > nCapacity )
+			return false;
+
+		nSize = 0;
+		if ( rEvent.get() )
+		{
+			std::memcpy( pData, rEvent.get(), sizeof( T ) );
+			nSize = sizeof( T );
+		}
+		priority = rEvent.time();
+		return true;
+	}
+
+	static void read( const char* pData, std::size_t nSize, unsigned long long priority, Measurement::Measurement< T >& rEvent )
+	{
+		if ( nSize == sizeof( T ) )
+			rEvent = Measurement::Measurement< T >( priority, boost::make_shared< T >( *reinterpret_cast< const T* >( pData ) ) );
+		else
+			rEvent = Measurement::Measurement< T >( priority, boost::shared_ptr< T >() );
+	}
+};
+
+
+/**
+ * \internal
+ * Converts events to and from the contents of shared memory slots. Measurements with bitwise
+ * copyable payloads are copied without serialization, other events are serialized.
+ */
+template< class EventType >
+struct ShmEventCodec
+	: public ShmSerializingCodec< EventType >
+{};
+
+template< class T >
+struct ShmEventCodec< Measurement::Measurement< T > >
+	: public ShmMeasurementCodec< T, ShmIsBitwiseCopyable< T >::value >
+{};
+
+
+/**
+ * @ingroup dataflow_framework
+ * Interface of the ports that connect a process to a shared memory ring.
+ */
+class ShmEndpoint
+{
+public:
+	virtual ~ShmEndpoint()
+	{}
+
+	/** returns the port */
+	virtual Port& getPort() = 0;
+
+	/** called when the network is started */
+	virtual void start()
+	{}
+
+	/** called when the network is stopped */
+	virtual void stop()
+	{}
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * A push consumer that writes the received events into a shared memory ring, to be sent by a
+ * ShmPushSupplier in another process.
+ *
+ * The event queue delivers the events as usual, so queue lengths and policies apply. If the ring
+ * is full because the other process is slow or not running, events are dropped.
+ *
+ * @param EventType type of the events
+ */
+template< class EventType >
+class ShmPushConsumer
+	: public PushConsumer< EventType >
+	, public ShmEndpoint
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param sName name of the port
+	 * @param rParent reference to the component this port belongs to
+	 * @param sChannel name of the shared memory segment
+	 * @param nSlots number of events in the ring
+	 * @param nSlotSize maximum size of a serialized event in bytes
+	 */
+	ShmPushConsumer( const std::string& sName, Component& rParent, const std::string& sChannel, std::size_t nSlots, std::size_t nSlotSize )
+		: PushConsumer< EventType >( sName, rParent, boost::bind( &ShmPushConsumer< EventType >::receivePush, this, _1 ) )
+		, m_ring( sChannel, nSlots, nSlotSize )
+		, m_logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.ShmPushConsumer" ) )
+	{}
+
+	Port& getPort()
+	{ return *this; }
+
+	/** returns the ring */
+	const ShmRing& getRing() const
+	{ return m_ring; }
+
+protected:
+	/** writes an event into the ring */
+	void receivePush( const EventType& rEvent )
+	{
+		char* pData = m_ring.beginWrite();
+		if ( !pData )
+		{
+			LOG4CPP_DEBUG( m_logger, this->fullName() << " dropped event, " << m_ring.getName() << " is full" );
+			return;
+		}
+
+		std::size_t nSize = 0;
+		unsigned long long priority = 0;
+		if ( !ShmEventCodec< EventType >::write( rEvent, pData, m_ring.getSlotSize(), nSize, priority ) )
+		{
+			LOG4CPP_WARN( m_logger, this->fullName() << " dropped event larger than the " << m_ring.getSlotSize() << " bytes of a slot" );
+			return;
+		}
+		m_ring.endWrite( nSize, priority );
+	}
+
+	/** the ring */
+	ShmRing m_ring;
+
+	/** for logging */
+	log4cpp::Category& m_logger;
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * A push supplier that sends the events written into a shared memory ring by a ShmPushConsumer
+ * in another process.
+ *
+ * While the port is started and connected, a thread polls the ring. It yields while events arrive.
+ * After the ring has been empty for a while, it sleeps between polls, starting with 100us and 
+ * doubling the sleep up to 10ms while the ring stays empty, so an idle port costs little CPU time. 
+ * The first event after a long idle period may therefore be delayed by up to 10ms. Events written 
+ * while the port was not running are discarded.
+ *
+ * Each event is read into a new event and its slot is released before the event is sent, so 
+ * consumers never hold on to the ring. Reading measurements with bitwise copyable payloads copies
+ * and allocates the payload once, other events are deserialized.
+ *
+ * @param EventType type of the events
+ */
+template< class EventType >
+class ShmPushSupplier
+	: public PushSupplier< EventType >
+	, public ShmEndpoint
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param sName name of the port
+	 * @param rParent reference to the component this port belongs to
+	 * @param sChannel name of the shared memory segment
+	 * @param nSlots number of events in the ring
+	 * @param nSlotSize maximum size of a serialized event in bytes
+	 */
+	ShmPushSupplier( const std::string& sName, Component& rParent, const std::string& sChannel, std::size_t nSlots, std::size_t nSlotSize )
+		: PushSupplier< EventType >( sName, rParent )
+		, m_ring( sChannel, nSlots, nSlotSize )
+		, m_bRunning( false )
+		, m_bStop( false )
+		, m_logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.ShmPushSupplier" ) )
+	{}
+
+	~ShmPushSupplier()
+	{ stopThread(); }
+
+	Port& getPort()
+	{ return *this; }
+
+	/** returns the ring */
+	const ShmRing& getRing() const
+	{ return m_ring; }
+
+	void start()
+	{
+		m_bRunning = true;
+		startThread();
+	}
+
+	void stop()
+	{
+		m_bRunning = false;
+		stopThread();
+	}
+
+	//@{
+	/** implements the Port interface. No events are sent while the connections change. */
+	void connect( Port& rOther )
+	{
+		PushSupplier< EventType >::connect( rOther );
+		if ( m_bRunning )
+			startThread();
+	}
+
+	void disconnect( Port& rOther )
+	{
+		stopThread();
+		PushSupplier< EventType >::disconnect( rOther );
+		if ( m_bRunning && this->isConnected() )
+			startThread();
+	}
+	//@}
+
+protected:
+	/** starts polling */
+	void startThread()
+	{
+		if ( m_pThread || !this->isConnected() )
+			return;
+
+		m_ring.discardPending();
+		m_bStop.store( false, boost::memory_order_relaxed );
+		m_pThread.reset( new boost::thread( boost::bind( &ShmPushSupplier< EventType >::threadFunction, this ) ) );
+	}
+
+	/** stops polling */
+	void stopThread()
+	{
+		if ( !m_pThread )
+			return;
+
+		m_bStop.store( true, boost::memory_order_relaxed );
+		m_pThread->join();
+		m_pThread.reset();
+	}
+
+	/** polls the ring and sends the events */
+	void threadFunction()
+	{
+		const long minSleep = 100;
+		const long maxSleep = 10000;
+		unsigned nIdle = 0;
+		long nSleep = minSleep;
+		while ( !m_bStop.load( boost::memory_order_relaxed ) )
+		{
+			std::size_t nSize = 0;
+			unsigned long long priority = 0;
+			const char* pData = m_ring.beginRead( nSize, priority );
+			if ( !pData )
+			{
+				// keep the latency low while events arrive, back off exponentially when they stop
+				if ( ++nIdle < 1000 )
+					boost::this_thread::yield();
+				else
+				{
+					boost::this_thread::sleep( boost::posix_time::microseconds( nSleep ) );
+					nSleep = std::min( 2 * nSleep, maxSleep );
+				}
+				continue;
+			}
+			nIdle = 0;
+			nSleep = minSleep;
+
+			EventType event;
+			try
+			{
+				ShmEventCodec< EventType >::read( pData, nSize, priority, event );
+			}
+			catch ( const std::exception& e )
+			{
+				m_ring.endRead();
+				LOG4CPP_ERROR( m_logger, this->fullName() << " cannot read event from " << m_ring.getName() << ": " << e.what() );
+				continue;
+			}
+			m_ring.endRead();
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+			this->send( std::move( event ) );
+#else
+			this->send( event );
+#endif
+		}
+	}
+
+	/** the ring */
+	ShmRing m_ring;
+
+	/** started by the network? */
+	bool m_bRunning;
+
+	/** tells the thread to end */
+	boost::atomic< bool > m_bStop;
+
+	/** the polling thread, if running */
+	boost::scoped_ptr< boost::thread > m_pThread;
+
+	/** for logging */
+	log4cpp::Category& m_logger;
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * Component holding the shared memory port of a connection to another process.
+ * Created by the DataflowNetwork for edges with the attribute transport="shm".
+ */
+class UTDATAFLOW_EXPORT ShmTransportComponent
+	: public Component
+{
+public:
+	/** @param sName name of the component */
+	ShmTransportComponent( const std::string& sName )
+		: Component( sName )
+	{}
+
+	/** sets the port, which is owned by the component */
+	void setEndpoint( ShmEndpoint* pEndpoint )
+	{ m_pEndpoint.reset( pEndpoint ); }
+
+	/** returns the port */
+	ShmEndpoint& getEndpoint()
+	{ return *m_pEndpoint; }
+
+	void start();
+
+	void stop();
+
+protected:
+	/** the port */
+	boost::scoped_ptr< ShmEndpoint > m_pEndpoint;
+};
+
+
+/**
+ * @ingroup dataflow_framework
+ * Creates shared memory ports for the event types of local ports.
+ *
+ * As the data flow network does not know the event types of ports, modules register the event
+ * types that can be passed to other processes, e.g. in their registerComponent() function:
+ * \code
+ * Dataflow::ShmTransport::registerEventType< Measurement::Pose >();
+ * \endcode
+ */
+class UTDATAFLOW_EXPORT ShmTransport
+{
+public:
+	/** settings of a shared memory connection */
+	struct Channel
+	{
+		Channel()
+			: nSlots( 64 )
+			, nSlotSize( 4096 )
+		{}
+
+		/** name of the shared memory segment */
+		std::string sName;
+
+		/** number of events in the ring */
+		std::size_t nSlots;
+
+		/** maximum size of a serialized event in bytes */
+		std::size_t nSlotSize;
+	};
+
+	/** makes events of a type available for shared memory connections */
+	template< class EventType >
+	static void registerEventType()
+	{ addEventType( typeid( EventType ).name(), boost::shared_ptr< EventTypeBase >( new EventTypeImpl< EventType > ) ); }
+
+	/**
+	 * Creates a shared memory port for a local port.
+	 * Throws a \c Ubitrack::Util::Exception if the event type of the port is not registered.
+	 *
+	 * @param rLocalPort the local port
+	 * @param bSend true if the local port pushes events to another process, false if it receives them
+	 * @param sName name of the new port
+	 * @param rParent component of the new port
+	 * @param channel the shared memory ring
+	 * @return a ShmPushConsumer if \c bSend is true, otherwise a ShmPushSupplier
+	 */
+	static ShmEndpoint* createEndpoint( Port& rLocalPort, bool bSend, const std::string& sName, Component& rParent, const Channel& channel );
+
+protected:
+	/** \internal creates ports for one event type */
+	class EventTypeBase
+	{
+	public:
+		virtual ~EventTypeBase()
+		{}
+
+		/** returns 0 if the local port has a different event type */
+		virtual ShmEndpoint* create( Port& rLocalPort, bool bSend, const std::string& sName, Component& rParent, const Channel& channel ) const = 0;
+	};
+
+	/** \internal creates ports for events of type EventType */
+	template< class EventType >
+	class EventTypeImpl
+		: public EventTypeBase
+	{
+	public:
+		ShmEndpoint* create( Port& rLocalPort, bool bSend, const std::string& sName, Component& rParent, const Channel& channel ) const
+		{
+			if ( bSend )
+			{
+				if ( !dynamic_cast< PushSupplierCore< EventType >* >( &rLocalPort ) )
+					return 0;
+				return new ShmPushConsumer< EventType >( sName, rParent, channel.sName, channel.nSlots, channel.nSlotSize );
+			}
+
+			if ( !dynamic_cast< PushConsumerCore< EventType >* >( &rLocalPort ) )
+				return 0;
+			return new ShmPushSupplier< EventType >( sName, rParent, channel.sName, channel.nSlots, channel.nSlotSize );
+		}
+	};
+
+	/** registers an event type */
+	static void addEventType( const std::string& sTypeName, boost::shared_ptr< EventTypeBase > pType );
+
+	/** type of map of registered event types by type name */
+	typedef std::map< std::string, boost::shared_ptr< EventTypeBase > > EventTypeMap;
+
+	/** returns the registered event types */
+	static EventTypeMap& getEventTypes();
+};
+
+
+} } // namespace Ubitrack::Dataflow
+
+#endif
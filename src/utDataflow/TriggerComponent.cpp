@@ -45,6 +45,8 @@ TriggerComponent::TriggerComponent( const std::string& name, boost::shared_ptr<
 	: Component( name )
 	, m_bPushOutput( false )
 	, m_bHasNewPush( false )
+	, m_bInEventBatch( false )
+	, m_pBatchTrigger( 0 )
 	, m_bExpansionConfigured( false )
 {
 	// make sure trigger group 0 exists
@@ -111,6 +113,13 @@ void TriggerComponent::generateSpaceExpansionPorts( boost::shared_ptr< Graph::UT
 void TriggerComponent::triggerIn( TriggerInPortBase* p )
 {
 	m_bHasNewPush = true;
+
+	// within a group of events, only check the trigger when all of them have arrived
+	if ( m_bInEventBatch )
+	{
+		m_pBatchTrigger = p;
+		return;
+	}
 	
 	// if the outport is push, get values from non-expanded ports and then compute result
 	if ( m_bPushOutput && m_triggerGroups[ 0 ]->trigger( p->getTimestamp() ) )
@@ -124,12 +133,40 @@ void TriggerComponent::triggerIn( TriggerInPortBase* p )
 }
 
 
+void TriggerComponent::beginEventBatch()
+{
+	m_bInEventBatch = true;
+	m_pBatchTrigger = 0;
+}
+
+
+void TriggerComponent::endEventBatch()
+{
+	m_bInEventBatch = false;
+	if ( !m_pBatchTrigger )
+		return;
+
+	TriggerInPortBase* p = m_pBatchTrigger;
+	m_pBatchTrigger = 0;
+	LOG4CPP_TRACE( eventsLogger, getName() << " triggering once for a group of events" );
+	triggerIn( p );
+}
+
+
 // called when a pull output port wants data
 void TriggerComponent::triggerOut( Measurement::Timestamp t )
+{
+	if ( !tryTriggerOut( t ) )
+		UBITRACK_THROW( getName() + ": No valid measurement for specified timestamp" );
+}
+
+
+// called when a pull output port wants data, without throwing if there is none
+bool TriggerComponent::tryTriggerOut( Measurement::Timestamp t )
 {
 	// Pull the default trigger group. This does not pull time-expanded input ports. See also ExpansionInPort.h
 	if ( !m_triggerGroups[ 0 ]->trigger( t ) )
-		UBITRACK_THROW( getName() + ": No valid measurement for specified timestamp" );
+		return false;
 
 	// if we got here safely, then all ports have valid values for the timestamp in question and we can compute a result
 	LOG4CPP_TRACE( eventsLogger, getName() << " starting computation on pull" );
@@ -137,6 +174,7 @@ void TriggerComponent::triggerOut( Measurement::Timestamp t )
 	m_bHasNewPush = false;
 	
 	// the result will be returned by the calling port
+	return true;
 }
 
 
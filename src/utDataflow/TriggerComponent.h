@@ -36,6 +36,7 @@
 #include <utDataflow.h>
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 #include <utMeasurement/Measurement.h>
@@ -43,6 +44,7 @@
 #include <utGraph/UTQLSubgraph.h>
 #include "Component.h"
 #include "Port.h"
+#include "PullThreadPool.h"
 
 namespace Ubitrack { namespace Dataflow {
 
@@ -79,10 +81,25 @@ public:
 	/** called when a push input is received */
 	void triggerIn( TriggerInPortBase* p );
 
+	/** 
+	 * Called before the event queue delivers a group of events with the same timestamp.
+	 * Defers the computation triggered by push inputs until endEventBatch().
+	 */
+	void beginEventBatch();
+
+	/** triggers the computation once for all push inputs received in the group */
+	void endEventBatch();
+
 	
-	/** called when a pull output port wants data */
+	/** called when a pull output port wants data. Throws if no result can be computed. */
 	void triggerOut( Measurement::Timestamp t );
 
+	/** 
+	 * called when a pull output port wants data. 
+	 * @return false if no result can be computed for the timestamp
+	 */
+	bool tryTriggerOut( Measurement::Timestamp t );
+
 	/** register a triggered input port */
 	TriggerGroup* addTriggerInput( TriggerInPortBase* p, int triggerGroup );
 	
@@ -112,6 +129,12 @@ private:
 	
 	// did the component receive new push inputs since the last compute()?
 	bool m_bHasNewPush;
+
+	// is the event queue delivering a group of events?
+	bool m_bInEventBatch;
+
+	// last push input received in the current group of events, 0 if none
+	TriggerInPortBase* m_pBatchTrigger;
 	
 	// map of trigger groups
 	typedef std::map< int, boost::shared_ptr< TriggerGroup > > TriggerGroupMap;
@@ -158,6 +181,25 @@ public:
 	TriggerInPortBase( const std::string& sName, TriggerComponent& rParent, int triggerGroup )
 		: Port( sName, rParent )
 		, m_bPush( rParent.isPortPush( sName ) )
+		, m_bLocal( false )
+		, m_timestamp( 0 )
+	{
+		m_pTriggerGroup = rParent.addTriggerInput( this, triggerGroup );
+	}
+
+	/** 
+	 * Constructor for ports that do not read the push/pull configuration from UTQL.
+	 *
+	 * @param sName Name of the port. Used for network instantiation.
+	 * @param rParent Reference to owning component where this port will be registered.
+	 * @param triggerGroup id of the trigger group for this port
+	 * @param bPush true if the trigger group checks the timestamp of the port, false if it pulls the port
+	 * @param bLocal true if pulling the port only reads data stored in the port, see isLocal()
+	 */
+	TriggerInPortBase( const std::string& sName, TriggerComponent& rParent, int triggerGroup, bool bPush, bool bLocal = false )
+		: Port( sName, rParent )
+		, m_bPush( bPush )
+		, m_bLocal( bLocal )
 		, m_timestamp( 0 )
 	{
 		m_pTriggerGroup = rParent.addTriggerInput( this, triggerGroup );
@@ -174,6 +216,13 @@ public:
 	virtual void pull( Measurement::Timestamp t )
 	{}
 
+	/**
+	 * Like pull(), but returns false if no measurement is available. Throws only on real errors.
+	 * The default implementation calls pull().
+	 */
+	virtual bool tryPull( Measurement::Timestamp t )
+	{ pull( t ); return true; }
+
 	/**
 	 * If the port is time expanded, add the stored measurement to the list.
 	 *
@@ -191,6 +240,13 @@ public:
 	/** returns true if the port is push, false if pull */
 	bool isPush() const
 	{ return m_bPush; }
+
+	/** 
+	 * Returns true if pulling the port only reads data stored in the port, e.g. a history of pushed 
+	 * measurements. Such pulls are too cheap to be run by the PullThreadPool.
+	 */
+	bool isLocal() const
+	{ return m_bLocal; }
 	
 	/** returns the timestamp of the stored measurement */
 	Measurement::Timestamp getTimestamp() const
@@ -203,6 +259,9 @@ public:
 protected:
 	/** True if push, false if pull */
 	bool m_bPush;
+
+	/** True if pulls only read data stored in the port */
+	bool m_bLocal;
 	
 	/** timestamp of the stored measurement */
 	Measurement::Timestamp m_timestamp;	
@@ -222,6 +281,8 @@ public:
 	TriggerGroup( TriggerComponent* pComponent, int iGroup )
 		: m_pComponent( pComponent )
 		, m_iGroup( iGroup )
+		, m_nPullPorts( 0 )
+		, m_rPullPool( PullThreadPool::singleton() )
 		, m_eventsLogger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.TriggerComponent" ) )
 	{}
 	
@@ -231,16 +292,25 @@ public:
 		LOG4CPP_DEBUG( m_eventsLogger, "adding trigger input " << pPort->fullName() << " to trigger group " << m_iGroup << " in component " << m_pComponent );
 		
 		m_ports.push_back( pPort );
+		if ( !pPort->isPush() && !pPort->isLocal() )
+			m_nPullPorts++;
 	}
 	
 	/** 
 	 * Trigger all ports belonging to the group, i.e. check the timestamp of push ports and pull pull ports.
+	 * If the PullThreadPool has threads, several pull ports that are not local are pulled in parallel, unless the calling 
+	 * thread delivers an event or a pull to a component they pull from, e.g. when the component 
+	 * receives an event by direct dispatch from a component it also pulls from. 
 	 * @return true if successfull
 	 */
 	bool trigger( Measurement::Timestamp t )
 	{
 		LOG4CPP_TRACE( m_eventsLogger, m_ports.size() << " ports to be triggered in group " << m_iGroup << " in component " << m_pComponent);
 
+		// pool threads would wait for the locked component while this thread waits for them
+		if ( m_nPullPorts > 1 && m_rPullPool.getNumberOfThreads() && !m_pComponent->isPullSourceLockedByThisThread() )
+			return triggerParallel( t );
+
 		for ( unsigned i = 0; i < m_ports.size(); i++ )
 			if ( m_ports[ i ]->isPush() )
 			{
@@ -255,27 +325,106 @@ public:
 			else
 			{
 				LOG4CPP_TRACE( m_eventsLogger, "port " << m_ports[i] << " is pull");
-				try
-				{ 
-					m_ports[ i ]->pull( t ); 
-				}
-				catch ( const Util::Exception& e )
-				{
-					LOG4CPP_DEBUG( m_eventsLogger, m_ports[ i ]->getComponent().getName() << " not computing: error on pull input: "  
-						<< m_ports[ i ]->getName() << ", reason: " << e );
+				if ( !pullPort( m_ports[ i ], t ) )
 					return false;
-				}
-				catch ( ... )
+			}
+			
+		return true;
+	}
+
+	/** pulls a port in the calling thread, logs and returns false if unsuccessful */
+	bool pullPort( TriggerInPortBase* pPort, Measurement::Timestamp t )
+	{
+		try
+		{ 
+			if ( !pPort->tryPull( t ) )
+			{
+				LOG4CPP_DEBUG( m_eventsLogger, pPort->getComponent().getName() << " not computing: no measurement on pull input: "  
+					<< pPort->getName() );
+				return false;
+			}
+		}
+		catch ( const Util::Exception& e )
+		{
+			LOG4CPP_DEBUG( m_eventsLogger, pPort->getComponent().getName() << " not computing: error on pull input: "  
+				<< pPort->getName() << ", reason: " << e );
+			return false;
+		}
+		catch ( ... )
+		{
+			LOG4CPP_DEBUG( m_eventsLogger, pPort->getComponent().getName() << " not computing: error on pull input: "  
+				<< pPort->getName() );
+			return false;
+		}
+		return true;
+	}
+
+	/** 
+	 * Like trigger(), but pulls the pull ports in parallel after the push and local ports have been checked.
+	 * The calling thread does the first pull itself and then joins the others.
+	 */
+	bool triggerParallel( Measurement::Timestamp t )
+	{
+		std::vector< TriggerInPortBase* > pullPorts;
+		for ( unsigned i = 0; i < m_ports.size(); i++ )
+			if ( m_ports[ i ]->isPush() )
+			{
+				if ( m_ports[ i ]->getTimestamp() != t )
 				{
-					LOG4CPP_DEBUG( m_eventsLogger, m_ports[ i ]->getComponent().getName() << " not computing: error on pull input: "  
+					LOG4CPP_DEBUG( m_eventsLogger, m_ports[ i ]->getComponent().getName() << " not computing: timestamps do not match on push input: "  
 						<< m_ports[ i ]->getName() );
 					return false;
 				}
 			}
-			
-		return true;
+			else if ( m_ports[ i ]->isLocal() )
+			{
+				if ( !pullPort( m_ports[ i ], t ) )
+					return false;
+			}
+			else
+				pullPorts.push_back( m_ports[ i ] );
+
+		// one result per task, char instead of bool so the tasks can write concurrently
+		std::vector< char > results( pullPorts.size(), 0 );
+		std::vector< boost::shared_ptr< PullTask > > tasks;
+		for ( unsigned i = 0; i < pullPorts.size(); i++ )
+		{
+			tasks.push_back( boost::shared_ptr< PullTask >( new PullTask( 
+				boost::bind( &TriggerGroup::tryPullInto, pullPorts[ i ], t, &results[ i ] ) ) ) );
+			if ( i > 0 )
+				m_rPullPool.submit( tasks.back() );
+		}
+
+		// all tasks must be finished before returning, as they write to the ports
+		bool bSuccess = true;
+		for ( unsigned i = 0; i < tasks.size(); i++ )
+		{
+			try
+			{
+				tasks[ i ]->join();
+			}
+			catch ( const Util::Exception& e )
+			{
+				LOG4CPP_DEBUG( m_eventsLogger, pullPorts[ i ]->getComponent().getName() << " not computing: error on pull input: "  
+					<< pullPorts[ i ]->getName() << ", reason: " << e );
+				bSuccess = false;
+				continue;
+			}
+
+			if ( !results[ i ] )
+			{
+				LOG4CPP_DEBUG( m_eventsLogger, pullPorts[ i ]->getComponent().getName() << " not computing: no measurement on pull input: "  
+					<< pullPorts[ i ]->getName() );
+				bSuccess = false;
+			}
+		}
+		return bSuccess;
 	}
 
+	/** pull task of triggerParallel() */
+	static void tryPullInto( TriggerInPortBase* pPort, Measurement::Timestamp t, char* pResult )
+	{ *pResult = pPort->tryPull( t ); }
+
 	/** makes the group store measurements for space/time expansion */
 	void storeMeasurements()
 	{
@@ -296,6 +445,12 @@ public:
 	/** list of ports belonging to this group */
 	PortList m_ports;
 
+	/** number of pull ports in m_ports that are not local */
+	unsigned m_nPullPorts;
+
+	/** pool for parallel pulls */
+	PullThreadPool& m_rPullPool;
+
 protected:	
 	/** logger */
 	log4cpp::Category& m_eventsLogger; 
@@ -77,6 +77,9 @@ public:
 	/** pull an event from a connected pushSupplier */
 	void pull( Ubitrack::Measurement::Timestamp );
 
+	/** pull an event from a connected pushSupplier, returns false if there is none */
+	bool tryPull( Ubitrack::Measurement::Timestamp );
+
 	/** are there any events queued for this port? */
 	bool eventsWaiting();
 	
@@ -88,6 +91,11 @@ protected:
 	/** called when an event is pushed in */
 	void receivePush( const EventType& );
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/** called when an event is pushed in that only this port receives */
+	void receiveMovedPush( EventType&& );
+#endif
+
 	/** prevent people from calling this method of PullConsumerCore directly */
 	EventType get( Ubitrack::Measurement::Timestamp )
 	{ assert( false ); return EventType(); }
@@ -103,6 +111,9 @@ TriggerInPort< EventType >::TriggerInPort( const std::string& sName, TriggerComp
 	, PushConsumerCore< EventType >( *this, boost::bind( &TriggerInPort< EventType >::receivePush, this, _1 ), &rParent.getMutex() )
 	, m_logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.TriggerInPort" ) )
 {
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	PushConsumerCore< EventType >::setMoveSlot( MemberMoveSlot< TriggerInPort< EventType >, EventType >( &TriggerInPort< EventType >::receiveMovedPush, this ) );
+#endif
 }
 
 
@@ -117,6 +128,22 @@ void TriggerInPort< EventType >::pull( Measurement::Timestamp t )
 }
 
 
+template< class EventType >
+bool TriggerInPort< EventType >::tryPull( Measurement::Timestamp t )
+{
+	assert( !isPush() );
+	if ( !PullConsumerCore< EventType >::tryGet( t, m_measurement ) )
+	{
+		LOG4CPP_DEBUG( m_logger, fullName() << " no measurement at " << t );
+		return false;
+	}
+	m_timestamp = m_measurement.time();
+
+	LOG4CPP_DEBUG( m_logger, fullName() << " pulled measurement at " << m_timestamp );
+	return true;
+}
+
+
 template< class EventType >
 bool TriggerInPort< EventType >::eventsWaiting()
 {
@@ -136,19 +163,39 @@ void TriggerInPort< EventType >::receivePush( const EventType& e )
 }
 
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+template< class EventType >
+void TriggerInPort< EventType >::receiveMovedPush( EventType&& e )
+{
+	LOG4CPP_DEBUG( m_logger, fullName() << " received measurement at " << e.time() );
+
+	m_timestamp = e.time();
+	m_measurement = std::move( e );
+
+	static_cast< TriggerComponent& >( m_rComponent ).triggerIn( this );
+}
+#endif
+
+
 template< class EventType >
 void TriggerInPort< EventType >::connect( Port& rOther )
 {
 	if ( !isPush() )
+	{
 		PullConsumerCore< EventType >::setPullSupplier( rOther, &rOther.getComponent().getMutex() );
+		m_rComponent.addPullSource( rOther.getComponent() );
+	}
 }
 
 
 template< class EventType >
-void TriggerInPort< EventType >::disconnect( Port& )
+void TriggerInPort< EventType >::disconnect( Port& rOther )
 {
 	if ( !isPush() )
+	{
 		PullConsumerCore< EventType >::removePullSupplier();
+		m_rComponent.removePullSource( rOther.getComponent() );
+	}
 }
 
 } } // namespace Ubitrack::Dataflow
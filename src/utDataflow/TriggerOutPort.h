@@ -66,22 +66,53 @@ public:
 	/** implements the Port interface */
 	void connect( Port& rOther );
 	void disconnect( Port& rOther );
+
+	void setPullCacheSize( std::size_t nEntries )
+	{ PullSupplierCore< EventType >::setCacheSize( nEntries, getComponent() ); }
 	//@}
 
 	/**
 	 * Send result to receivers.
 	 *
 	 * @param rEvent The data to send.
+	 * @return status of the push, always send_ok for pull ports
+	 */
+	SendStatus send( const EventType& rEvent )
+	{
+		LOG4CPP_DEBUG( m_logger, fullName() << " sending event" );
+
+		if ( m_bPush )
+			return PushSupplierCore< EventType >::send( rEvent );
+
+		m_measurement = rEvent;
+		return send_ok;
+	}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	/**
+	 * Send result to receivers, moving it into the queue or the pull buffer.
+	 *
+	 * @param rEvent The data to send.
+	 * @return status of the push, always send_ok for pull ports
 	 */
-	void send( const EventType& rEvent )
+	SendStatus send( EventType&& rEvent )
 	{
 		LOG4CPP_DEBUG( m_logger, fullName() << " sending event" );
 
 		if ( m_bPush )
-			PushSupplierCore< EventType >::send( rEvent );
-		else
-			m_measurement = rEvent;
+			return PushSupplierCore< EventType >::send( std::move( rEvent ) );
+
+		m_measurement = std::move( rEvent );
+		return send_ok;
 	}
+#endif
+
+	/** 
+	 * Returns true if the port is push and all connected consumers are saturated, see 
+	 * PushSupplierCore::isSaturated(). Components can skip computing results nobody can consume.
+	 */
+	bool isSaturated() const
+	{ return m_bPush && PushSupplierCore< EventType >::isSaturated(); }
 
 protected:
 	/** is this a push port? */
@@ -92,6 +123,9 @@ protected:
 
 	/** receives pull requests from a \c PullConsumer */
 	EventType pullRequest( Measurement::Timestamp );
+
+	/** receives non-throwing pull requests from a \c PullConsumer */
+	bool tryPullRequest( Measurement::Timestamp, EventType& result );
 	
 	/** the pull time */
 	Measurement::Timestamp m_timestamp;
@@ -104,7 +138,8 @@ protected:
 template< class EventType >
 TriggerOutPort< EventType >::TriggerOutPort( const std::string& sName, TriggerComponent& rParent )
 	: Port( sName, rParent )
-	, PullSupplierCore< EventType >( boost::bind( &TriggerOutPort< EventType >::pullRequest, this, _1 ) )
+	, PullSupplierCore< EventType >( boost::bind( &TriggerOutPort< EventType >::pullRequest, this, _1 ), 
+		boost::bind( &TriggerOutPort< EventType >::tryPullRequest, this, _1, _2 ) )
 	, m_bPush( rParent.isPortPush( sName ) )
 	, m_logger( log4cpp::Category::getInstance( "Ubitrack.Events.Dataflow.TriggerOutPort" ) )
 {
@@ -128,6 +163,22 @@ EventType TriggerOutPort< EventType >::pullRequest( Measurement::Timestamp t )
 }
 
 
+template< class EventType >
+bool TriggerOutPort< EventType >::tryPullRequest( Measurement::Timestamp t, EventType& result )
+{
+	LOG4CPP_DEBUG( m_logger, fullName() << " got pullRequest for " << t );
+
+	m_timestamp = t;
+
+	// trigger computation - puts something in m_measurement if successful
+	if ( !static_cast< TriggerComponent& >( m_rComponent ).tryTriggerOut( t ) )
+		return false;
+
+	result = m_measurement;
+	return true;
+}
+
+
 template< class EventType >
 void TriggerOutPort< EventType >::connect( Port& rOther )
 {
@@ -0,0 +1,185 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Benchmark that counts how often an event is copied and moved on its way
+ * from a PushSupplier to its PushConsumers. The consumers keep the last event,
+ * which accounts for one copy or move per consumer.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <utMeasurement/Timestamp.h>
+#include <utDataflow/Component.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/EventQueue.h>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Dataflow;
+
+/** event type that counts its copies and moves */
+struct CountedEvent
+{
+	static unsigned long s_nCopies;
+	static unsigned long s_nMoves;
+
+	CountedEvent()
+		: m_payload( 64, 0.0 )
+	{}
+
+	CountedEvent( const CountedEvent& other )
+		: m_payload( other.m_payload )
+	{ s_nCopies++; }
+
+	CountedEvent& operator=( const CountedEvent& other )
+	{
+		m_payload = other.m_payload;
+		s_nCopies++;
+		return *this;
+	}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	CountedEvent( CountedEvent&& other )
+		: m_payload( std::move( other.m_payload ) )
+	{ s_nMoves++; }
+
+	CountedEvent& operator=( CountedEvent&& other )
+	{
+		m_payload = std::move( other.m_payload );
+		s_nMoves++;
+		return *this;
+	}
+#endif
+
+	std::vector< double > m_payload;
+};
+
+unsigned long CountedEvent::s_nCopies = 0;
+unsigned long CountedEvent::s_nMoves = 0;
+
+
+/** sends events */
+class Source
+	: public Component
+{
+public:
+	Source()
+		: Component( "Source" )
+		, m_out( "Output", *this )
+	{}
+
+	PushSupplier< CountedEvent > m_out;
+};
+
+
+/** receives events and keeps the last one */
+class Sink
+	: public Component
+{
+public:
+	Sink( const std::string& sName, bool bMove )
+		: Component( sName )
+		, m_in( "Input", *this, boost::bind( &Sink::receive, this, _1 ) )
+	{
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+		if ( bMove )
+			m_in.setMoveSlot( MemberMoveSlot< Sink, CountedEvent >( &Sink::receiveMoved, this ) );
+#endif
+	}
+
+	void receive( const CountedEvent& e )
+	{ m_last = e; }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	void receiveMoved( CountedEvent&& e )
+	{ m_last = std::move( e ); }
+#endif
+
+	PushConsumer< CountedEvent > m_in;
+	CountedEvent m_last;
+};
+
+
+/** sends events to a number of sinks and prints the copies and moves per event */
+static void run( const char* sName, unsigned nSinks, bool bRvalue, bool bMoveSlot, unsigned nEvents )
+{
+	Source source;
+	std::vector< boost::shared_ptr< Sink > > sinks;
+	for ( unsigned i = 0; i < nSinks; i++ )
+	{
+		sinks.push_back( boost::shared_ptr< Sink >( new Sink( "Sink" + std::string( 1, char( 'A' + i ) ), bMoveSlot ) ) );
+		source.m_out.connect( sinks.back()->m_in );
+	}
+
+	EventQueue& rQueue( EventQueue::singleton() );
+	CountedEvent::s_nCopies = 0;
+	CountedEvent::s_nMoves = 0;
+	Measurement::Timestamp start = Measurement::now();
+
+	for ( unsigned i = 0; i < nEvents; i++ )
+	{
+		CountedEvent e;
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+		if ( bRvalue )
+			source.m_out.send( std::move( e ) );
+		else
+#endif
+			source.m_out.send( e );
+		rQueue.dispatchNow();
+	}
+
+	Measurement::Timestamp duration = Measurement::now() - start;
+	std::printf( "%-40s copies/event: %5.2f  moves/event: %5.2f  ns/event: %8.1f\n", sName,
+		double( CountedEvent::s_nCopies ) / nEvents, double( CountedEvent::s_nMoves ) / nEvents, double( duration ) / nEvents );
+
+	for ( unsigned i = 0; i < nSinks; i++ )
+		rQueue.removeComponent( sinks[ i ].get() );
+}
+
+
+int main( int argc, char** argv )
+{
+	unsigned nEvents = argc > 1 ? std::atoi( argv[ 1 ] ) : 100000;
+
+	run( "1 consumer, send( const& )", 1, false, false, nEvents );
+	run( "1 consumer, send( const& ), move slot", 1, false, true, nEvents );
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	run( "1 consumer, send( && )", 1, true, false, nEvents );
+	run( "1 consumer, send( && ), move slot", 1, true, true, nEvents );
+#endif
+	run( "3 consumers, send( const& )", 3, false, false, nEvents );
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	run( "3 consumers, send( && )", 3, true, false, nEvents );
+#endif
+
+	EventQueue::destroyEventQueue();
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Benchmark that measures the latency of a chain of push components, with events 
+ * going through the event queue and with direct dispatch.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <utMeasurement/Timestamp.h>
+#include <utDataflow/Component.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/EventQueue.h>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Dataflow;
+
+/** event that carries the time it was sent */
+struct TimedEvent
+{
+	TimedEvent( Measurement::Timestamp _sent = 0 )
+		: sent( _sent )
+	{}
+
+	Measurement::Timestamp sent;
+};
+
+
+/** sends events */
+class Source
+	: public Component
+{
+public:
+	Source()
+		: Component( "Source" )
+		, m_out( "Output", *this )
+	{}
+
+	PushSupplier< TimedEvent > m_out;
+};
+
+
+/** forwards events */
+class Filter
+	: public Component
+{
+public:
+	Filter( const std::string& sName )
+		: Component( sName )
+		, m_in( "Input", *this, boost::bind( &Filter::receive, this, _1 ) )
+		, m_out( "Output", *this )
+	{}
+
+	void receive( const TimedEvent& e )
+	{ m_out.send( e ); }
+
+	PushConsumer< TimedEvent > m_in;
+	PushSupplier< TimedEvent > m_out;
+};
+
+
+/** stores the arrival time of the last event */
+class Sink
+	: public Component
+{
+public:
+	Sink()
+		: Component( "Sink" )
+		, m_in( "Input", *this, boost::bind( &Sink::receive, this, _1 ) )
+		, m_latency( 0 )
+	{}
+
+	void receive( const TimedEvent& e )
+	{ m_latency.store( Measurement::now() - e.sent + 1, boost::memory_order_release ); }
+
+	PushConsumer< TimedEvent > m_in;
+	boost::atomic< unsigned long long > m_latency;
+};
+
+
+/** sends events through a chain of \c nHops connections and prints the latency from source to sink */
+static void run( unsigned nHops, bool bDirect, unsigned nEvents )
+{
+	Source source;
+	std::vector< boost::shared_ptr< Filter > > filters;
+	Sink sink;
+
+	PushSupplier< TimedEvent >* pOut = &source.m_out;
+	for ( unsigned i = 1; i < nHops; i++ )
+	{
+		filters.push_back( boost::shared_ptr< Filter >( new Filter( "Filter" + std::string( 1, char( 'A' + i ) ) ) ) );
+		pOut->connect( filters.back()->m_in );
+		pOut->setDirectDispatch( bDirect );
+		pOut = &filters.back()->m_out;
+	}
+	pOut->connect( sink.m_in );
+	pOut->setDirectDispatch( bDirect );
+
+	// send one event at a time and wait for it at the sink
+	std::vector< unsigned long long > latencies;
+	latencies.reserve( nEvents );
+	for ( unsigned i = 0; i < nEvents; i++ )
+	{
+		sink.m_latency.store( 0, boost::memory_order_relaxed );
+		source.m_out.send( TimedEvent( Measurement::now() ) );
+
+		unsigned long long latency;
+		while ( !( latency = sink.m_latency.load( boost::memory_order_acquire ) ) )
+			;
+		latencies.push_back( latency - 1 );
+	}
+
+	std::sort( latencies.begin(), latencies.end() );
+	double sum = 0.0;
+	for ( unsigned i = 0; i < nEvents; i++ )
+		sum += latencies[ i ];
+
+	std::printf( "%u hops, %-8s mean: %8.1f ns  median: %8llu ns  99%%: %8llu ns\n", nHops, bDirect ? "direct" : "queued",
+		sum / nEvents, latencies[ nEvents / 2 ], latencies[ nEvents * 99 / 100 ] );
+
+	EventQueue::singleton().removeComponent( &sink );
+	for ( unsigned i = 0; i < filters.size(); i++ )
+		EventQueue::singleton().removeComponent( filters[ i ].get() );
+}
+
+
+int main( int argc, char** argv )
+{
+	unsigned nEvents = argc > 1 ? std::max( 1, std::atoi( argv[ 1 ] ) ) : 100000;
+
+	EventQueue& rQueue( EventQueue::singleton() );
+	rQueue.start();
+
+	for ( unsigned nHops = 1; nHops <= 6; nHops++ )
+	{
+		run( nHops, false, nEvents );
+		run( nHops, true, nEvents );
+	}
+
+	rQueue.stop();
+	EventQueue::destroyEventQueue();
+	return 0;
+}
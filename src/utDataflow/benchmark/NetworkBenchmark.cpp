@@ -0,0 +1,442 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Benchmark that builds synthetic dataflow networks from generated UTQL documents and
+ * measures throughput, end-to-end latency, dropped events and memory usage.
+ *
+ * The network consists of source components, \c depth layers of trigger components and
+ * one sink behind each component of the last layer. Each trigger component has \c fanIn
+ * push inputs from the previous layer and \c pullInputs pull inputs from the sources, and
+ * the output of each component is consumed by about \c fanOut components of the next layer.
+ *
+ * Without arguments, a fixed suite of networks is measured. Otherwise a single network is
+ * built from options like \c --sources=8 \c --depth=4 \c --fan-in=2 \c --fan-out=2
+ * \c --pull-inputs=1 \c --frames=20000 \c --window=32 \c --queue-length=0 \c --rate=0
+ * \c --threads=1.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <utMeasurement/Measurement.h>
+#include <utGraph/UTQLReader.h>
+#include <utDataflow/Component.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utDataflow/DataflowNetwork.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PullSupplier.h>
+#include <utDataflow/TriggerComponent.h>
+#include <utDataflow/TriggerInPort.h>
+#include <utDataflow/TriggerOutPort.h>
+#include <utDataflow/EventQueue.h>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Dataflow;
+
+/** events carry the frame number as value and the time the frame was sent as timestamp */
+typedef Measurement::Distance BenchEvent;
+
+
+/** sends the frames into the network and answers pull requests */
+class BenchSource
+	: public Component
+{
+public:
+	BenchSource( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > )
+		: Component( sName )
+		, m_out( "Output", *this )
+		, m_pullOut( "PullOutput", *this, boost::bind( &BenchSource::pull, this, _1 ) )
+	{}
+
+	BenchEvent pull( Measurement::Timestamp t )
+	{ return BenchEvent( t, 1.0 ); }
+
+	PushSupplier< BenchEvent > m_out;
+	PullSupplier< BenchEvent > m_pullOut;
+};
+
+
+/** combines all inputs with the same timestamp and sends the frame number of the first input */
+class BenchNode
+	: public TriggerComponent
+{
+public:
+	BenchNode( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph )
+		: TriggerComponent( sName, pSubgraph )
+		, m_out( "Output", *this )
+	{
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = pSubgraph->m_Edges.begin(); it != pSubgraph->m_Edges.end(); it++ )
+			if ( it->second->isInput() )
+				m_inputs.push_back( boost::shared_ptr< TriggerInPort< BenchEvent > >( new TriggerInPort< BenchEvent >( it->first, *this ) ) );
+	}
+
+	void compute( Measurement::Timestamp t )
+	{
+		double frame = 0.0;
+		for ( std::size_t i = 0; i < m_inputs.size(); i++ )
+			if ( m_inputs[ i ]->isPush() )
+				frame = std::max( frame, *m_inputs[ i ]->get() );
+
+		m_out.send( BenchEvent( t, frame ) );
+	}
+
+	std::vector< boost::shared_ptr< TriggerInPort< BenchEvent > > > m_inputs;
+	TriggerOutPort< BenchEvent > m_out;
+};
+
+
+/** records the latency of all received events */
+class BenchSink
+	: public Component
+{
+public:
+	BenchSink( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > )
+		: Component( sName )
+		, m_in( "Input", *this, boost::bind( &BenchSink::receive, this, _1 ) )
+		, m_lastFrame( -1 )
+		, m_lastTime( 0 )
+	{}
+
+	void receive( const BenchEvent& e )
+	{
+		const Measurement::Timestamp now( Measurement::now() );
+		m_latencies.push_back( now - e.time() );
+		m_lastTime.store( now, boost::memory_order_relaxed );
+		m_lastFrame.store( static_cast< long long >( *e ), boost::memory_order_release );
+	}
+
+	PushConsumer< BenchEvent > m_in;
+
+	/** only accessed by the event queue while the network runs */
+	std::vector< unsigned long long > m_latencies;
+
+	boost::atomic< long long > m_lastFrame;
+	boost::atomic< unsigned long long > m_lastTime;
+};
+
+
+/** parameters of a network */
+struct NetworkConfig
+{
+	NetworkConfig()
+		: nSources( 8 ), nDepth( 4 ), nFanIn( 2 ), nFanOut( 2 ), nPullInputs( 0 )
+		, nFrames( 20000 ), nWindow( 32 ), nQueueLength( 0 ), nRate( 0 ), nThreads( 1 )
+	{}
+
+	unsigned nSources;
+	unsigned nDepth;
+	unsigned nFanIn;
+	unsigned nFanOut;
+	unsigned nPullInputs;
+	unsigned nFrames;
+
+	/** maximum number of frames in the network at the same time */
+	unsigned nWindow;
+
+	/** maxQueueLength of the input edges, 0 for unbounded queues */
+	unsigned nQueueLength;
+
+	/** frames per second, 0 to send as fast as the window allows */
+	unsigned nRate;
+
+	/** number of event queue threads */
+	unsigned nThreads;
+};
+
+
+/** returns a value in kB from /proc/self/status, or 0 if it is not available */
+static unsigned long readMemoryStatus( const char* sKey )
+{
+	std::ifstream status( "/proc/self/status" );
+	std::string sLine;
+	while ( std::getline( status, sLine ) )
+		if ( sLine.compare( 0, std::strlen( sKey ), sKey ) == 0 )
+			return std::strtoul( sLine.c_str() + std::strlen( sKey ) + 1, 0, 10 );
+	return 0;
+}
+
+
+/** writes an edge of a pattern */
+static void writeEdge( std::ostream& out, const std::string& sName, const char* sSource, const char* sDestination,
+	const std::string& sPatternRef, const std::string& sEdgeRef, const char* sMode, unsigned nQueueLength )
+{
+	out << "<Edge name=\"" << sName << "\" source=\"" << sSource << "\" destination=\"" << sDestination << "\"";
+	if ( !sPatternRef.empty() )
+		out << " pattern-ref=\"" << sPatternRef << "\" edge-ref=\"" << sEdgeRef << "\"";
+	out << "><Attribute name=\"mode\" value=\"" << sMode << "\"/>";
+	if ( nQueueLength )
+		out << "<Attribute name=\"maxQueueLength\" value=\"" << nQueueLength << "\"/>";
+	out << "</Edge>";
+}
+
+
+/** returns the name of the j-th component in a layer, layer 0 are the sources */
+static std::string layerComponent( unsigned nLayer, unsigned j )
+{
+	std::ostringstream name;
+	if ( nLayer == 0 )
+		name << "Source" << j;
+	else
+		name << "Node" << nLayer << "_" << j;
+	return name.str();
+}
+
+
+/**
+ * Generates the UTQL response of a network.
+ * @param widths receives the number of components in each layer
+ */
+static std::string generateUTQL( const NetworkConfig& config, std::vector< unsigned >& widths )
+{
+	std::ostringstream out;
+	out << "<UTQLResponse>\n";
+
+	widths.assign( 1, std::max( 1u, config.nSources ) );
+	for ( unsigned j = 0; j < widths[ 0 ]; j++ )
+	{
+		out << "<Pattern name=\"BenchSource\" id=\"" << layerComponent( 0, j ) << "\"><Output><Node name=\"A\"/><Node name=\"B\"/>";
+		writeEdge( out, "Output", "A", "B", "", "", "push", 0 );
+		writeEdge( out, "PullOutput", "A", "B", "", "", "pull", 0 );
+		out << "</Output><DataflowConfiguration><UbitrackLib class=\"BenchSource\"/></DataflowConfiguration></Pattern>\n";
+	}
+
+	for ( unsigned nLayer = 1; nLayer <= config.nDepth; nLayer++ )
+	{
+		const unsigned nPrevious = widths.back();
+		widths.push_back( std::max( 1u, nPrevious * config.nFanOut / config.nFanIn ) );
+
+		for ( unsigned j = 0; j < widths.back(); j++ )
+		{
+			out << "<Pattern name=\"BenchNode\" id=\"" << layerComponent( nLayer, j ) << "\"><Input><Node name=\"A\"/><Node name=\"B\"/>";
+			for ( unsigned k = 0; k < config.nFanIn; k++ )
+			{
+				std::ostringstream sInput;
+				sInput << "Input" << k;
+				writeEdge( out, sInput.str(), "A", "B", layerComponent( nLayer - 1, ( j * config.nFanIn + k ) / config.nFanOut % nPrevious ),
+					"Output", "push", config.nQueueLength );
+			}
+			for ( unsigned k = 0; k < config.nPullInputs; k++ )
+			{
+				std::ostringstream sInput;
+				sInput << "PullInput" << k;
+				writeEdge( out, sInput.str(), "A", "B", layerComponent( 0, ( j + k ) % widths[ 0 ] ), "PullOutput", "pull", 0 );
+			}
+			out << "</Input><Output><Node name=\"C\"/>";
+			writeEdge( out, "Output", "A", "C", "", "", "push", 0 );
+			out << "</Output><DataflowConfiguration><UbitrackLib class=\"BenchNode\"/></DataflowConfiguration></Pattern>\n";
+		}
+	}
+
+	for ( unsigned j = 0; j < widths.back(); j++ )
+	{
+		out << "<Pattern name=\"BenchSink\" id=\"Sink" << j << "\"><Input><Node name=\"A\"/><Node name=\"B\"/>";
+		writeEdge( out, "Input", "A", "B", layerComponent( config.nDepth, j ), "Output", "push", config.nQueueLength );
+		out << "</Input><DataflowConfiguration><UbitrackLib class=\"BenchSink\"/></DataflowConfiguration></Pattern>\n";
+	}
+
+	out << "</UTQLResponse>\n";
+	return out.str();
+}
+
+
+/** returns the smallest frame number received by all sinks */
+static long long completedFrame( const std::vector< boost::shared_ptr< BenchSink > >& sinks )
+{
+	long long nFrame = sinks[ 0 ]->m_lastFrame.load( boost::memory_order_acquire );
+	for ( std::size_t i = 1; i < sinks.size(); i++ )
+		nFrame = std::min( nFrame, sinks[ i ]->m_lastFrame.load( boost::memory_order_acquire ) );
+	return nFrame;
+}
+
+
+/** builds a network, sends the frames and prints the results */
+static void run( ComponentFactory& factory, const NetworkConfig& config )
+{
+	const unsigned long rssBefore = readMemoryStatus( "VmRSS:" );
+
+	std::vector< unsigned > widths;
+	std::istringstream utql( generateUTQL( config, widths ) );
+
+	boost::shared_ptr< EventQueue > pQueue( new EventQueue( config.nThreads ) );
+	DataflowNetwork network( factory, pQueue );
+	network.processUTQLResponse( Graph::UTQLReader::processInput( utql ) );
+
+	std::vector< boost::shared_ptr< BenchSource > > sources( network.componentsByType< BenchSource >() );
+	std::vector< boost::shared_ptr< BenchSink > > sinks( network.componentsByType< BenchSink >() );
+	unsigned nComponents = 0;
+	for ( std::size_t i = 0; i < widths.size(); i++ )
+		nComponents += widths[ i ];
+	nComponents += widths.back();
+
+	network.startNetwork();
+	const unsigned long rssStarted = readMemoryStatus( "VmRSS:" );
+
+	// send the frames, keeping at most nWindow of them in the network
+	const Measurement::Timestamp startTime( Measurement::now() );
+	for ( unsigned nFrame = 0; nFrame < config.nFrames; nFrame++ )
+	{
+		if ( config.nRate )
+		{
+			const Measurement::Timestamp dueTime( startTime + 1000000000ULL * nFrame / config.nRate );
+			const Measurement::Timestamp now( Measurement::now() );
+			if ( dueTime > now )
+				boost::this_thread::sleep( boost::posix_time::microseconds( ( dueTime - now ) / 1000 ) );
+		}
+
+		while ( static_cast< long long >( nFrame ) - completedFrame( sinks ) > static_cast< long long >( config.nWindow ) &&
+			Measurement::now() - startTime < 1000000000ULL * 60 )
+			boost::this_thread::yield();
+
+		BenchEvent e( Measurement::now(), double( nFrame ) );
+		for ( std::size_t i = 0; i < sources.size(); i++ )
+			sources[ i ]->m_out.send( e );
+	}
+
+	// wait for the last frame, or until nothing arrives for a second because events were dropped
+	Measurement::Timestamp lastProgress( Measurement::now() );
+	long long nLastCompleted = -1;
+	while ( completedFrame( sinks ) < static_cast< long long >( config.nFrames ) - 1 && Measurement::now() - lastProgress < 1000000000ULL )
+	{
+		if ( completedFrame( sinks ) != nLastCompleted )
+		{
+			nLastCompleted = completedFrame( sinks );
+			lastProgress = Measurement::now();
+		}
+		boost::this_thread::sleep( boost::posix_time::microseconds( 100 ) );
+	}
+
+	network.stopNetwork();
+
+	// collect the results
+	Measurement::Timestamp endTime( startTime );
+	std::vector< unsigned long long > latencies;
+	for ( std::size_t i = 0; i < sinks.size(); i++ )
+	{
+		latencies.insert( latencies.end(), sinks[ i ]->m_latencies.begin(), sinks[ i ]->m_latencies.end() );
+		endTime = std::max< Measurement::Timestamp >( endTime, sinks[ i ]->m_lastTime.load( boost::memory_order_relaxed ) );
+	}
+	std::sort( latencies.begin(), latencies.end() );
+
+	unsigned long long nDispatched = 0;
+	unsigned long long nDropped = 0;
+	DataflowNetwork::QueueStatisticsMap statistics( network.getQueueStatistics() );
+	for ( DataflowNetwork::QueueStatisticsMap::iterator it = statistics.begin(); it != statistics.end(); it++ )
+	{
+		nDispatched += it->second.nDispatched + it->second.nDirect;
+		nDropped += it->second.nDropped + it->second.nExpired;
+	}
+
+	const double seconds = double( endTime - startTime ) * 1e-9;
+	const unsigned long long nExpected = static_cast< unsigned long long >( config.nFrames ) * sinks.size();
+	std::printf( "sources %3u depth %2u fan-in %2u fan-out %2u pull %u queue %4u threads %u: %5u components\n",
+		config.nSources, config.nDepth, config.nFanIn, config.nFanOut, config.nPullInputs, config.nQueueLength, config.nThreads, nComponents );
+	std::printf( "  frames/s: %10.0f  events/s: %10.0f  delivered: %llu/%llu  dropped: %llu\n",
+		seconds > 0 ? config.nFrames / seconds : 0.0, seconds > 0 ? nDispatched / seconds : 0.0,
+		static_cast< unsigned long long >( latencies.size() ), nExpected, nDropped );
+	if ( !latencies.empty() )
+		std::printf( "  latency us  p50: %9.1f  p90: %9.1f  p99: %9.1f  p99.9: %9.1f  max: %9.1f\n",
+			latencies[ latencies.size() / 2 ] * 1e-3, latencies[ latencies.size() * 9 / 10 ] * 1e-3,
+			latencies[ latencies.size() * 99 / 100 ] * 1e-3, latencies[ latencies.size() * 999 / 1000 ] * 1e-3,
+			latencies.back() * 1e-3 );
+	std::printf( "  memory kB   network: %9ld  running: %9ld  peak: %9lu\n",
+		long( rssStarted ) - long( rssBefore ), long( readMemoryStatus( "VmRSS:" ) ) - long( rssBefore ), readMemoryStatus( "VmHWM:" ) );
+	std::fflush( stdout );
+}
+
+
+/** parses an option of the form --name=value */
+static bool parseOption( const char* sArg, const char* sName, unsigned& value )
+{
+	const std::size_t nLength = std::strlen( sName );
+	if ( std::strncmp( sArg, "--", 2 ) || std::strncmp( sArg + 2, sName, nLength ) || sArg[ nLength + 2 ] != '=' )
+		return false;
+	value = static_cast< unsigned >( std::max( 0, std::atoi( sArg + nLength + 3 ) ) );
+	return true;
+}
+
+
+int main( int argc, char** argv )
+{
+	ComponentFactory factory( ( std::vector< std::string >() ) );
+	factory.registerComponent< BenchSource >( "BenchSource" );
+	factory.registerComponent< BenchNode >( "BenchNode" );
+	factory.registerComponent< BenchSink >( "BenchSink" );
+
+	NetworkConfig config;
+	if ( argc > 1 )
+	{
+		for ( int i = 1; i < argc; i++ )
+			if ( !parseOption( argv[ i ], "sources", config.nSources ) && !parseOption( argv[ i ], "depth", config.nDepth ) &&
+				!parseOption( argv[ i ], "fan-in", config.nFanIn ) && !parseOption( argv[ i ], "fan-out", config.nFanOut ) &&
+				!parseOption( argv[ i ], "pull-inputs", config.nPullInputs ) && !parseOption( argv[ i ], "frames", config.nFrames ) &&
+				!parseOption( argv[ i ], "window", config.nWindow ) && !parseOption( argv[ i ], "queue-length", config.nQueueLength ) &&
+				!parseOption( argv[ i ], "rate", config.nRate ) && !parseOption( argv[ i ], "threads", config.nThreads ) )
+			{
+				std::fprintf( stderr, "unknown option %s\n", argv[ i ] );
+				return 1;
+			}
+
+		config.nFanIn = std::max( 1u, config.nFanIn );
+		config.nFanOut = std::max( 1u, config.nFanOut );
+		config.nThreads = std::max( 1u, config.nThreads );
+		run( factory, config );
+		return 0;
+	}
+
+	// the default suite: chains, wide and narrowing/widening networks, with and without pull edges
+	static const unsigned suite[][ 5 ] = {
+		// sources, depth, fan-in, fan-out, pull inputs
+		{ 1, 8, 1, 1, 0 },
+		{ 16, 2, 1, 1, 0 },
+		{ 8, 3, 2, 1, 0 },
+		{ 1, 3, 1, 2, 0 },
+		{ 8, 4, 2, 2, 0 },
+		{ 8, 4, 2, 2, 1 },
+		{ 8, 4, 1, 1, 2 }
+	};
+
+	for ( std::size_t i = 0; i < sizeof( suite ) / sizeof( suite[ 0 ] ); i++ )
+	{
+		config.nSources = suite[ i ][ 0 ];
+		config.nDepth = suite[ i ][ 1 ];
+		config.nFanIn = suite[ i ][ 2 ];
+		config.nFanOut = suite[ i ][ 3 ];
+		config.nPullInputs = suite[ i ][ 4 ];
+		run( factory, config );
+	}
+
+	return 0;
+}
@@ -0,0 +1,391 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_framework
+ * @file
+ * Microbenchmarks of the individual port operations: pushing to several consumers,
+ * pulling through chains of components, triggering and time expansion.
+ *
+ * Every measurement is repeated several times and the median is printed, so results of
+ * different runs can be compared. The event queue threads are not started, pushed events
+ * are dispatched by the benchmark thread.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <utMeasurement/Measurement.h>
+#include <utGraph/UTQLSubgraph.h>
+#include <utDataflow/Component.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PullSupplier.h>
+#include <utDataflow/PullConsumer.h>
+#include <utDataflow/TriggerComponent.h>
+#include <utDataflow/TriggerInPort.h>
+#include <utDataflow/TriggerOutPort.h>
+#include <utDataflow/ExpansionInPort.h>
+#include <utDataflow/EventQueue.h>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Dataflow;
+
+/** number of repetitions of each measurement */
+static const unsigned g_nRepetitions = 7;
+
+/** number of operations per repetition, can be scaled on the command line */
+static unsigned g_nOperations = 100000;
+
+
+/** returns a name with a number appended */
+static std::string numbered( const std::string& sName, unsigned n )
+{
+	std::ostringstream name;
+	name << sName << n;
+	return name.str();
+}
+
+
+/** prints the median of the measured nanoseconds per operation */
+static void report( const std::string& sName, std::vector< double >& times )
+{
+	std::sort( times.begin(), times.end() );
+	std::printf( "%-48s %10.1f ns/op  (min %10.1f)\n", sName.c_str(), times[ times.size() / 2 ], times[ 0 ] );
+	std::fflush( stdout );
+}
+
+
+/** pushes events */
+class Source
+	: public Component
+{
+public:
+	Source()
+		: Component( "Source" )
+		, m_out( "Output", *this )
+		, m_pullOut( "PullOutput", *this, boost::bind( &Source::pull, this, _1 ) )
+	{}
+
+	Measurement::Distance pull( Measurement::Timestamp t )
+	{ return Measurement::Distance( t, 1.0 ); }
+
+	PushSupplier< Measurement::Distance > m_out;
+	PullSupplier< Measurement::Distance > m_pullOut;
+};
+
+
+/** receives pushed events */
+class Sink
+	: public Component
+{
+public:
+	Sink( const std::string& sName )
+		: Component( sName )
+		, m_in( "Input", *this, boost::bind( &Sink::receive, this, _1 ) )
+	{}
+
+	void receive( const Measurement::Distance& e )
+	{ m_last = e; }
+
+	PushConsumer< Measurement::Distance > m_in;
+	Measurement::Distance m_last;
+};
+
+
+/** forwards pull requests */
+class PullRelay
+	: public Component
+{
+public:
+	PullRelay( const std::string& sName )
+		: Component( sName )
+		, m_in( "Input", *this )
+		, m_out( "Output", *this, boost::bind( &PullRelay::pull, this, _1 ) )
+	{}
+
+	Measurement::Distance pull( Measurement::Timestamp t )
+	{ return m_in.get( t ); }
+
+	PullConsumer< Measurement::Distance > m_in;
+	PullSupplier< Measurement::Distance > m_out;
+};
+
+
+/** pulls events */
+class PullSink
+	: public Component
+{
+public:
+	PullSink()
+		: Component( "PullSink" )
+		, m_in( "Input", *this )
+	{}
+
+	PullConsumer< Measurement::Distance > m_in;
+};
+
+
+/** trigger component with push and pull inputs and a pull output, so pushes do not compute */
+class Trigger
+	: public TriggerComponent
+{
+public:
+	Trigger( boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph, unsigned nPush, unsigned nPull )
+		: TriggerComponent( "Trigger", pSubgraph )
+		, m_out( "Output", *this )
+	{
+		for ( unsigned i = 0; i < nPush; i++ )
+			m_pushInputs.push_back( boost::shared_ptr< TriggerInPort< Measurement::Distance > >(
+				new TriggerInPort< Measurement::Distance >( numbered( "PushInput", i ), *this ) ) );
+		for ( unsigned i = 0; i < nPull; i++ )
+			m_pullInputs.push_back( boost::shared_ptr< TriggerInPort< Measurement::Distance > >(
+				new TriggerInPort< Measurement::Distance >( numbered( "PullInput", i ), *this ) ) );
+	}
+
+	void compute( Measurement::Timestamp t )
+	{ m_out.send( Measurement::Distance( t, 1.0 ) ); }
+
+	std::vector< boost::shared_ptr< TriggerInPort< Measurement::Distance > > > m_pushInputs;
+	std::vector< boost::shared_ptr< TriggerInPort< Measurement::Distance > > > m_pullInputs;
+	TriggerOutPort< Measurement::Distance > m_out;
+};
+
+
+/** time-expanded trigger component */
+class Expansion
+	: public TriggerComponent
+{
+public:
+	Expansion( boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph )
+		: TriggerComponent( "Expansion", pSubgraph )
+		, m_in( "Input", *this )
+		, m_out( "Output", *this )
+	{}
+
+	void compute( Measurement::Timestamp t )
+	{}
+
+	ExpansionInPort< double > m_in;
+	TriggerOutPort< Measurement::Distance > m_out;
+};
+
+
+/** adds an edge with a "mode" attribute to a subgraph */
+static void addEdge( Graph::UTQLSubgraph& subgraph, const std::string& sName, bool bInput, const std::string& sMode )
+{
+	Graph::UTQLSubgraph::EdgePtr pEdge( subgraph.addEdge( sName, "A", "B",
+		bInput ? Graph::UTQLSubgraph::GraphEdgeAttributes::Input : Graph::UTQLSubgraph::GraphEdgeAttributes::Output ) );
+	pEdge->setAttribute( "mode", Graph::AttributeValue( sMode ) );
+}
+
+
+/** creates a subgraph for a trigger component */
+static boost::shared_ptr< Graph::UTQLSubgraph > triggerSubgraph( unsigned nPush, unsigned nPull )
+{
+	boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph( new Graph::UTQLSubgraph( "Trigger", "Trigger" ) );
+	pSubgraph->addNode( "A", Graph::UTQLSubgraph::GraphNodeAttributes::Input );
+	pSubgraph->addNode( "B", Graph::UTQLSubgraph::GraphNodeAttributes::Input );
+	for ( unsigned i = 0; i < nPush; i++ )
+		addEdge( *pSubgraph, numbered( "PushInput", i ), true, "push" );
+	for ( unsigned i = 0; i < nPull; i++ )
+		addEdge( *pSubgraph, numbered( "PullInput", i ), true, "pull" );
+	addEdge( *pSubgraph, "Output", false, "pull" );
+	return pSubgraph;
+}
+
+
+/** measures PushSupplier::send to a number of consumers, without and with dispatching */
+static void benchmarkSend( unsigned nConsumers )
+{
+	EventQueue& rQueue( EventQueue::singleton() );
+	Source source;
+	std::vector< boost::shared_ptr< Sink > > sinks;
+	for ( unsigned i = 0; i < nConsumers; i++ )
+	{
+		sinks.push_back( boost::shared_ptr< Sink >( new Sink( numbered( "Sink", i ) ) ) );
+		source.m_out.connect( sinks.back()->m_in );
+	}
+
+	// events are dispatched in blocks, so the queue stays small
+	const unsigned nBlock = 256;
+	std::vector< double > sendTimes;
+	std::vector< double > totalTimes;
+	Measurement::Distance e( 1, 1.0 );
+	for ( unsigned r = 0; r < g_nRepetitions; r++ )
+	{
+		Measurement::Timestamp sendTime = 0;
+		const Measurement::Timestamp start( Measurement::now() );
+		for ( unsigned n = 0; n < g_nOperations; n += nBlock )
+		{
+			const Measurement::Timestamp blockStart( Measurement::now() );
+			for ( unsigned i = 0; i < nBlock; i++ )
+				source.m_out.send( e );
+			sendTime += Measurement::now() - blockStart;
+			rQueue.dispatchNow();
+		}
+		const unsigned nSent = ( g_nOperations + nBlock - 1 ) / nBlock * nBlock;
+		sendTimes.push_back( double( sendTime ) / nSent );
+		totalTimes.push_back( double( Measurement::now() - start ) / nSent );
+	}
+
+	report( numbered( "PushSupplier::send, consumers: ", nConsumers ), sendTimes );
+	report( numbered( "PushSupplier::send + dispatch, consumers: ", nConsumers ), totalTimes );
+
+	for ( unsigned i = 0; i < nConsumers; i++ )
+		rQueue.removeComponent( sinks[ i ].get() );
+}
+
+
+/** measures PullConsumer::get through a chain of components */
+static void benchmarkPull( unsigned nDepth )
+{
+	Source source;
+	PullSink sink;
+	std::vector< boost::shared_ptr< PullRelay > > relays;
+
+	Port* pSupplier = &source.m_pullOut;
+	for ( unsigned i = 1; i < nDepth; i++ )
+	{
+		relays.push_back( boost::shared_ptr< PullRelay >( new PullRelay( numbered( "Relay", i ) ) ) );
+		relays.back()->m_in.connect( *pSupplier );
+		pSupplier = &relays.back()->m_out;
+	}
+	sink.m_in.connect( *pSupplier );
+
+	std::vector< double > times;
+	for ( unsigned r = 0; r < g_nRepetitions; r++ )
+	{
+		const Measurement::Timestamp start( Measurement::now() );
+		for ( unsigned i = 0; i < g_nOperations; i++ )
+			sink.m_in.get( i + 1 );
+		times.push_back( double( Measurement::now() - start ) / g_nOperations );
+	}
+
+	report( numbered( "PullConsumer::get, depth: ", nDepth ), times );
+}
+
+
+/** measures TriggerGroup::trigger with push and pull inputs */
+static void benchmarkTrigger( unsigned nPush, unsigned nPull )
+{
+	EventQueue& rQueue( EventQueue::singleton() );
+	Source source;
+	Trigger trigger( triggerSubgraph( nPush, nPull ), nPush, nPull );
+	for ( unsigned i = 0; i < nPush; i++ )
+		source.m_out.connect( *trigger.m_pushInputs[ i ] );
+	for ( unsigned i = 0; i < nPull; i++ )
+		trigger.m_pullInputs[ i ]->connect( source.m_pullOut );
+
+	// give all push inputs the same timestamp
+	const Measurement::Timestamp t( 1 );
+	source.m_out.send( Measurement::Distance( t, 1.0 ) );
+	rQueue.dispatchNow();
+	TriggerGroup* pGroup( nPush ? trigger.m_pushInputs[ 0 ]->getTriggerGroup() : trigger.m_pullInputs[ 0 ]->getTriggerGroup() );
+
+	std::vector< double > times;
+	for ( unsigned r = 0; r < g_nRepetitions; r++ )
+	{
+		const Measurement::Timestamp start( Measurement::now() );
+		for ( unsigned i = 0; i < g_nOperations; i++ )
+			if ( !pGroup->trigger( t ) )
+				std::abort();
+		times.push_back( double( Measurement::now() - start ) / g_nOperations );
+	}
+
+	std::ostringstream name;
+	name << "TriggerGroup::trigger, push: " << nPush << ", pull: " << nPull;
+	report( name.str(), times );
+
+	rQueue.removeComponent( &trigger );
+}
+
+
+/** measures ExpansionInPort::storeMeasurement while the vector of the port grows */
+static void benchmarkExpansion()
+{
+	EventQueue& rQueue( EventQueue::singleton() );
+	boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph( new Graph::UTQLSubgraph( "Expansion", "Expansion" ) );
+	pSubgraph->addNode( "A", Graph::UTQLSubgraph::GraphNodeAttributes::Input );
+	pSubgraph->addNode( "B", Graph::UTQLSubgraph::GraphNodeAttributes::Input );
+	addEdge( *pSubgraph, "Input", true, "push" );
+	addEdge( *pSubgraph, "Output", false, "pull" );
+	pSubgraph->m_DataflowAttributes.setAttribute( "expansion", Graph::AttributeValue( std::string( "time" ) ) );
+
+	// the vector grows by one measurement per call, it is measured in ranges of sizes
+	static const unsigned sizes[] = { 16, 256, 4096, 65536 };
+	std::vector< std::vector< double > > times( sizeof( sizes ) / sizeof( sizes[ 0 ] ) );
+	for ( unsigned r = 0; r < g_nRepetitions; r++ )
+	{
+		Source source;
+		Expansion expansion( pSubgraph );
+		source.m_out.connect( expansion.m_in );
+		source.m_out.send( Measurement::Distance( 1, 1.0 ) );
+		rQueue.dispatchNow();
+
+		unsigned nSize = expansion.m_in.get()->size();
+		for ( std::size_t s = 0; s < times.size(); s++ )
+		{
+			const unsigned nCalls = sizes[ s ] - nSize;
+			const Measurement::Timestamp start( Measurement::now() );
+			for ( unsigned i = 0; i < nCalls; i++ )
+				expansion.m_in.storeMeasurement();
+			times[ s ].push_back( double( Measurement::now() - start ) / nCalls );
+			nSize = sizes[ s ];
+		}
+
+		rQueue.removeComponent( &expansion );
+	}
+
+	for ( std::size_t s = 0; s < times.size(); s++ )
+		report( numbered( "ExpansionInPort::storeMeasurement, size <= ", sizes[ s ] ), times[ s ] );
+}
+
+
+int main( int argc, char** argv )
+{
+	if ( argc > 1 )
+		g_nOperations = std::max( 256, std::atoi( argv[ 1 ] ) );
+
+	benchmarkSend( 1 );
+	benchmarkSend( 4 );
+	benchmarkSend( 16 );
+
+	for ( unsigned nDepth = 1; nDepth <= 10; nDepth++ )
+		benchmarkPull( nDepth );
+
+	benchmarkTrigger( 1, 0 );
+	benchmarkTrigger( 4, 0 );
+	benchmarkTrigger( 1, 1 );
+	benchmarkTrigger( 1, 4 );
+
+	benchmarkExpansion();
+
+	EventQueue::destroyEventQueue();
+	return 0;
+}